@@ -43,6 +43,22 @@
 #include <media/lirc_dev.h>
 #include <linux/gpio.h>
 #include <linux/of_platform.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/slab.h>
+#include <linux/jump_label.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/kfifo.h>
+#include <linux/semaphore.h>
+#include <linux/vmalloc.h>
+#include <linux/bitops.h>
+#include <linux/atomic.h>
+#include <linux/crc-ccitt.h>
+
+#include "lirc_tegra.h"
 
 #define LIRC_DRIVER_NAME "lirc_tegra"
 #define RBUF_LEN 256
@@ -55,6 +71,17 @@
 #endif
 
 #define LIRC_TEGRA_MAX_TRANSMITTERS 8
+/* upper bound on output changes in one compiled frame */
+#define TX_MAX_STEPS 65536
+/* data link: preamble, length, payload and crc bits, closing mark */
+#define LINK_MAX_SAMPLES (2 + 16 * (LIRC_TEGRA_LINK_MAX + 4) + 1)
+#define LINK_MIN_UNIT_US (2 * LIRC_TRANSMITTER_LATENCY)
+#define TXLOG_EDGES 1024
+#define TXLOG_FRAMES 64
+#define TXSTATS_BUCKETS 256
+#define RXLAT_BUCKETS 24
+/* a space at least this long (us) ends a frame */
+#define RX_FRAME_GAP 20000
 #define INVALID -1
 #define dprintk(fmt, args...)					\
 	do {							\
@@ -88,19 +115,131 @@ static bool softcarrier = 1;
 static bool invert = 0;
 /* Transmit mask */
 unsigned int tx_mask = 0xFFFFFFFF; /* All transmitters selected as default */
+/* record actual vs target output edges into the debugfs tx log */
+static bool txlog = 0;
+/* listen-before-talk: receiver quiet time required before sending, 0 = off */
+static unsigned int lbt_window_us = 0;
+/* listen-before-talk: retries and upper bound of the random backoff */
+static unsigned int lbt_retries = 5;
+static unsigned int lbt_backoff_us = 20000;
+/* listen-before-talk: edges this long after our own frame are its echo */
+static unsigned int lbt_echo_us = 1000;
+/* data link: length of one signalling unit */
+static unsigned int link_unit_us = 100;
 
 struct gpio_chip *gpiochip;
 static int irq_num;
+/* set while the IRQ is requested, protected by irq_cfg_mutex */
+static bool irq_held;
+static DEFINE_MUTEX(irq_cfg_mutex);
+/* CPU to route the GPIO IRQ to, -1 = leave it to the kernel */
+static int irq_cpu = -1;
+/* scheduling of the IRQ thread, -1 = kernel default (fifo 50) */
+static int irq_thread_policy = -1;
+static int irq_thread_prio = MAX_USER_RT_PRIO / 2;
+/* bumped on every change, the IRQ thread then applies them to itself */
+static atomic_t irq_sched_gen = ATOMIC_INIT(0);
+/* the generation the IRQ thread last applied, only touched by it */
+static int irq_sched_applied;
 
 /* forward declarations */
-static long send_pulse(unsigned long length);
-static void send_space(long length);
 static void lirc_tegra_exit(void);
 
 static struct platform_device *lirc_tegra_dev;
 static struct timeval lasttv = { 0, 0 };
 static struct lirc_buffer rbuf;
 static spinlock_t lock;
+/* serializes the receive path between the IRQ and rx_inject */
+static DEFINE_SPINLOCK(rx_lock);
+static u64 rx_overruns;
+/* CPU the IRQ thread last woke readers on, to count cross-CPU wakeups */
+static int rx_irq_cpu = -1;
+static u64 rx_reads;
+static u64 rx_xcpu_wakeups;
+
+/*
+ * Edges as irq_handler() saw them, waiting for irq_thread_fn() to turn
+ * them into samples. One producer and one consumer, so no lock.
+ */
+struct rx_hw_edge {
+	u64 ns;
+	int signal;
+};
+
+static DECLARE_KFIFO(rx_hw_edges, struct rx_hw_edge, RBUF_LEN);
+static u32 rx_hw_edges_lost;
+
+/*
+ * Every sample written to rbuf is stamped with the time the edge that
+ * produced it reached irq_handler(), which runs in hard IRQ context as
+ * it is requested with IRQF_NO_THREAD. Injected samples are stamped when
+ * they are injected. The stamps are popped in step with read(), under
+ * rx_read_mutex, which turns them into edge-to-read latencies. The fifo
+ * is twice the size of rbuf, as the IRQ can refill rbuf before read()
+ * gets to pop its stamps.
+ */
+struct rx_stamp {
+	u64 ns;
+	int sample;
+};
+
+static DECLARE_KFIFO(rx_stamps, struct rx_stamp, 2 * RBUF_LEN);
+static u64 rx_edge_ns;
+static DEFINE_MUTEX(rx_read_mutex);
+
+/*
+ * Edge-to-read latency of the last pulse of each frame in log2 us buckets,
+ * protected by rxlat_mutex.
+ */
+static DEFINE_MUTEX(rxlat_mutex);
+static struct {
+	u32 hist[RXLAT_BUCKETS];
+	u64 frames;
+	u64 total_ns;
+	u64 min_ns;
+	u64 max_ns;
+	u64 pending_ns;
+	bool pending;
+} rxlat;
+
+/*
+ * While a transaction is capturing, samples are diverted here instead of
+ * rbuf. Protected by rx_lock, one capture at a time by rx_capture_mutex.
+ */
+static struct {
+	bool active;
+	int *buf;
+	unsigned int len;
+	unsigned int max;
+	unsigned int want;	/* wake the waiter once this many are in */
+	u64 start_ns;	/* edges before this are ignored */
+	u64 first_ns;	/* start of the first response pulse */
+} rx_capture;
+static DEFINE_MUTEX(rx_capture_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(rx_capture_wait);
+
+/* data link throughput, protected by link_mutex */
+static DEFINE_MUTEX(link_mutex);
+static struct {
+	u64 tx_bytes;
+	u64 tx_ns;
+	u64 rx_bytes;
+	u64 rx_ns;
+	u64 rx_errors;
+} link_stats;
+
+/* rx_inject perturbation knobs and results */
+static DEFINE_MUTEX(rx_inject_mutex);
+static u32 rx_inject_jitter_us;
+static u32 rx_inject_glitch_permille;
+static u32 rx_inject_glitch_us = 50;
+static u32 rx_inject_drop_permille;
+static struct {
+	u64 edges;
+	u64 glitches;
+	u64 dropped;
+	u64 ns;
+} rx_inject_stats;
 
 /* initialized/set in init_timing_params() */
 static unsigned int freq = 38000;
@@ -109,6 +248,87 @@ static unsigned long period;
 static unsigned long pulse_width;
 static unsigned long space_width;
 
+/*
+ * TX capture log. Every output toggle is recorded with the time it was
+ * scheduled for and the time it actually happened, both in ns relative
+ * to the start of the frame. Disabled, the only cost is a patched-out
+ * branch per frame and a NULL check per edge.
+ */
+struct txlog_edge {
+	u32 frame;
+	u32 level;
+	u64 target;	/* ns into the frame, frames can run for seconds */
+	u64 actual;
+};
+
+struct txlog_frame {
+	u32 seq;
+	u32 edges;
+	u64 start_ns;
+	s32 overshoot;	/* actual - target end of frame */
+	u32 max_err;	/* largest |actual - target| of any edge */
+};
+
+static DEFINE_STATIC_KEY_FALSE(txlog_key);
+static struct txlog_edge txlog_edges[TXLOG_EDGES];
+static struct txlog_frame txlog_frames[TXLOG_FRAMES];
+static unsigned int txlog_edge_head;
+static unsigned int txlog_frame_head;
+static struct txlog_frame *txlog_cur;
+static u64 txlog_t0;
+
+/*
+ * A frame as compiled by lirc_write() before it takes the lock: one step
+ * per output change, with its deadline in ns from the start of the frame
+ * and the physical level of each transmitter as a bitmask.
+ */
+struct tx_step {
+	u64 deadline;
+	u32 levels;
+	u8 level;	/* logical level, for the tx log */
+	u8 carrier;	/* softcarrier toggle within a pulse */
+};
+
+struct tx_table {
+	struct tx_step *steps;	/* TX_MAX_STEPS, allocated at init */
+	unsigned int len;
+	u32 pins;	/* transmitters driven by this frame */
+	u64 end;	/* deadline for switching all outputs off */
+};
+
+/*
+ * Two tables, so that one writer can compile its frame while another
+ * writer's frame is being transmitted. tx_slots counts the free ones, tx_tables_busy marks them.
+ */
+static struct tx_table tx_tables[2];
+static unsigned long tx_tables_busy;
+static struct semaphore tx_slots;
+/* when the last frame finished, to tell its own echo from other senders */
+static u64 tx_end_ns;
+/* bumped by concurrent writers */
+static atomic_t lbt_collisions;
+static atomic_t lbt_aborts;
+
+/*
+ * TX fidelity statistics, accumulated from the tx log while it is
+ * enabled. Edge errors are binned in 1 us buckets, the last bucket
+ * catching everything larger.
+ */
+static struct {
+	u32 err_hist[TXSTATS_BUCKETS];
+	u64 edges;
+	u32 err_max;
+	u64 carrier_target_ns;
+	u64 carrier_actual_ns;
+	u64 carrier_halves;
+	u64 frames;
+	/* time lock was held with interrupts off, not system-wide impact */
+	u64 irqoff_total_ns;
+	u32 irqoff_max_ns;
+} txstats;
+
+static struct dentry *debugfs_dir;
+
 static bool inline transmitter_enabled(int n) {
 	return tx_mask & (1 << n);
 }
@@ -122,11 +342,87 @@ static void safe_udelay(unsigned long usecs)
 	udelay(usecs);
 }
 
-static unsigned long read_current_us(void)
+/* busy-wait until ktime_get_ns() reaches deadline */
+static void tx_wait_until(u64 deadline)
 {
-	struct timespec now;
-	getnstimeofday(&now);
-	return (now.tv_sec * 1000000) + (now.tv_nsec/1000);
+	u64 now = ktime_get_ns();
+
+	/* udelay() to just short of the deadline, then spin the rest */
+	if (deadline > now + 2 * NSEC_PER_USEC)
+		safe_udelay(div_u64(deadline - now, NSEC_PER_USEC) - 1);
+	while (ktime_get_ns() < deadline)
+		cpu_relax();
+}
+
+/* called with lock held, t0 being the start of the frame */
+static void txlog_frame_begin(u64 t0)
+{
+	if (!static_branch_unlikely(&txlog_key)) {
+		txlog_cur = NULL;
+		return;
+	}
+	txlog_cur = &txlog_frames[txlog_frame_head % TXLOG_FRAMES];
+	txlog_cur->seq = txlog_frame_head;
+	txlog_cur->edges = 0;
+	txlog_cur->overshoot = 0;
+	txlog_cur->max_err = 0;
+	txlog_t0 = t0;
+	txlog_cur->start_ns = txlog_t0;
+}
+
+/* returns the actual edge time in ns into the frame, 0 when not logging */
+static u64 txlog_edge(u64 target, int level)
+{
+	struct txlog_edge *e;
+	u64 actual;
+	u32 err;
+
+	if (!txlog_cur)
+		return 0;
+	actual = ktime_get_ns() - txlog_t0;
+	err = actual > target ? actual - target : target - actual;
+
+	e = &txlog_edges[txlog_edge_head++ % TXLOG_EDGES];
+	e->frame = txlog_cur->seq;
+	e->target = target;
+	e->actual = actual;
+	e->level = level;
+
+	txlog_cur->edges++;
+	if (err > txlog_cur->max_err)
+		txlog_cur->max_err = err;
+
+	txstats.err_hist[min_t(u32, err / 1000, TXSTATS_BUCKETS - 1)]++;
+	txstats.edges++;
+	if (err > txstats.err_max)
+		txstats.err_max = err;
+	return actual;
+}
+
+/* target and actual length of softcarrier half periods */
+static void txlog_carrier(u64 target, u64 actual, unsigned int halves)
+{
+	if (!txlog_cur || !halves)
+		return;
+	txstats.carrier_target_ns += target;
+	txstats.carrier_actual_ns += actual;
+	txstats.carrier_halves += halves;
+}
+
+static void txlog_frame_end(u64 target)
+{
+	u64 irqoff;
+
+	if (!txlog_cur)
+		return;
+	irqoff = ktime_get_ns() - txlog_t0;
+	txlog_cur->overshoot = (s64)(irqoff - target);
+	txstats.frames++;
+	txstats.irqoff_total_ns += irqoff;
+	if (irqoff > txstats.irqoff_max_ns)
+		txstats.irqoff_max_ns = min_t(u64, irqoff, U32_MAX);
+	txlog_frame_head++;
+	txlog_cur = NULL;
 }
 
 static int init_timing_params(unsigned int new_duty_cycle,
@@ -156,77 +452,199 @@ static int init_timing_params(unsigned int new_duty_cycle,
 	return 0;
 }
 
-static long send_pulse_softcarrier(unsigned long length)
+static int tx_step_add(struct tx_table *t, u64 deadline, int level,
+		       int carrier)
+{
+	if (t->len == TX_MAX_STEPS)
+		return -E2BIG;
+	t->steps[t->len].deadline = deadline;
+	t->steps[t->len].levels = level ^ invert ? t->pins : 0;
+	t->steps[t->len].level = level;
+	t->steps[t->len].carrier = carrier;
+	t->len++;
+	return 0;
+}
+
+static int compile_pulse_softcarrier(struct tx_table *t, u64 start, u64 end)
 {
-	int flag;
-	unsigned i;
-	unsigned long actual, target;
-	unsigned long actual_us, initial_us, target_us;
+	int flag, result;
+	u64 at;
+
+	/*
+	 * Note - we've checked in ioctl that the pulse/space
+	 * widths are big enough to be met.
+	 */
+	for (at = start, flag = 1; at < end; flag = !flag) {
+		result = tx_step_add(t, at, flag, 1);
+		if (result)
+			return result;
+		at += flag ? pulse_width : space_width;
+	}
+	return 0;
+}
 
-	length *= 1000;
+static int compile_pulse(struct tx_table *t, u64 start, long length,
+			 bool carrier)
+{
+	if (length <= 0)
+		return 0;
 
-	actual = 0; target = 0; flag = 0;
-	actual_us = read_current_us();
+	if (carrier && softcarrier && freq > 0)
+		return compile_pulse_softcarrier(t, start,
+						 start + length * 1000ULL);
+	return tx_step_add(t, start, 1, 0);
+}
 
-	while (actual < length) {
-		for (i = 0; i < n_transmitters; i++)
-			if (transmitter_enabled(i))
-				gpiochip->set(gpiochip, gpio_out_pin[i], ! (flag ^ invert));
-		target += flag ? space_width : pulse_width;
+static int compile_space(struct tx_table *t, u64 start)
+{
+	return tx_step_add(t, start, 0, 0);
+}
 
-		initial_us = actual_us;
-		target_us = actual_us + (target - actual) / 1000;
-		/*
-		 * Note - we've checked in ioctl that the pulse/space
-		 * widths are big enough so that d is > 0
-		 */
-		if  ((int)(target_us - actual_us) > 0)
-			udelay(target_us - actual_us);
-		actual_us = read_current_us();
-		actual += (actual_us - initial_us) * 1000;
-		flag = !flag;
+/*
+ * Turn a pulse/space buffer into a table of absolute deadlines. Runs
+ * without the lock, so a frame can be compiled while another is sent.
+ */
+static int tx_compile(struct tx_table *t, const int *wbuf, int count,
+		      bool carrier)
+{
+	int i, result;
+	u64 at = 0;
+
+	t->len = 0;
+	t->pins = 0;
+	for (i = 0; i < n_transmitters; i++)
+		if (transmitter_enabled(i))
+			t->pins |= 1 << i;
+
+	for (i = 0; i < count; i++) {
+		if (i%2)
+			result = compile_space(t, at);
+		else
+			result = compile_pulse(t, at, wbuf[i], carrier);
+		if (result)
+			return result;
+		at += (u64)max(wbuf[i], 0) * 1000;
 	}
-	return (actual-length) / 1000;
+	t->end = at;
+	return 0;
 }
 
-static long send_pulse(unsigned long length)
+/* called with lock held */
+static void tx_replay(struct tx_table *t)
 {
-	unsigned int i;
-
-	if (length <= 0)
-		return 0;
+	struct tx_step *step, *prev = NULL;
+	u64 t0, actual, prev_actual = 0;
+	unsigned int i, j;
+
+	t0 = ktime_get_ns();
+	txlog_frame_begin(t0);
+	for (i = 0; i < t->len; i++) {
+		step = &t->steps[i];
+		tx_wait_until(t0 + step->deadline);
+		for (j = 0; j < n_transmitters; j++)
+			if (t->pins & (1 << j))
+				gpiochip->set(gpiochip, gpio_out_pin[j],
+					      (step->levels >> j) & 1);
+		actual = txlog_edge(step->deadline, step->level);
+		if (step->carrier && prev && prev->carrier)
+			txlog_carrier(step->deadline - prev->deadline,
+				      actual - prev_actual, 1);
+		prev = step;
+		prev_actual = actual;
+	}
+	tx_wait_until(t0 + t->end);
+	for (i = 0; i < n_transmitters; i++)
+		gpiochip->set(gpiochip, gpio_out_pin[i], invert);
+	txlog_edge(t->end, 0);
+	txlog_frame_end(t->end);
+	WRITE_ONCE(tx_end_ns, ktime_get_ns());
+}
 
-	if (softcarrier && freq > 0) {
-		return send_pulse_softcarrier(length);
-	} else {
-		for (i = 0; i < n_transmitters; i++)
-			if (transmitter_enabled(i))
-				gpiochip->set(gpiochip, gpio_out_pin[i], !invert);
+/*
+ * Listen before talk: hold off while the receiver has seen an edge within
+ * the last lbt_window_us, backing off for a random time between tries.
+ * Edges up to lbt_echo_us after the end of our own last frame are taken
+ * to be its echo: the receiver's demodulator delays them, and edges that
+ * came in while the frame held the lock are only stamped once it is
+ * released, after tx_end_ns.
+ */
+static int tx_listen(void)
+{
+	unsigned int tries, delay;
+	u64 edge;
 
-		safe_udelay(length);
+	if (!lbt_window_us || gpio_in_pin == INVALID)
 		return 0;
+	for (tries = 0; ; tries++) {
+		edge = READ_ONCE(rx_edge_ns);
+		if (edge <= READ_ONCE(tx_end_ns) +
+		    (u64)lbt_echo_us * NSEC_PER_USEC ||
+		    ktime_get_ns() - edge >= (u64)lbt_window_us * NSEC_PER_USEC)
+			return 0;
+		atomic_inc(&lbt_collisions);
+		if (tries >= lbt_retries) {
+			atomic_inc(&lbt_aborts);
+			dprintk("channel busy, giving up\n");
+			return -EBUSY;
+		}
+		delay = lbt_window_us + prandom_u32_max(lbt_backoff_us + 1);
+		usleep_range(delay, delay + 100);
 	}
 }
 
-static void send_space(long length)
+static struct tx_table *tx_table_get(void)
 {
-	unsigned i;
-	for (i = 0; i < n_transmitters; i++)
-		if (transmitter_enabled(i))
-			gpiochip->set(gpiochip, gpio_out_pin[i], invert);
-	if (length <= 0)
+	int i;
+
+	if (down_interruptible(&tx_slots))
+		return ERR_PTR(-ERESTARTSYS);
+	for (i = 0; test_and_set_bit(i, &tx_tables_busy); i++)
+		;
+	return &tx_tables[i];
+}
+
+static void tx_table_put(struct tx_table *t)
+{
+	clear_bit(t - tx_tables, &tx_tables_busy);
+	up(&tx_slots);
+}
+
+/* called with rx_lock held; leading spaces before the response are dropped */
+static void rx_capture_add(int l, u64 end_ns)
+{
+	if (end_ns < rx_capture.start_ns ||
+	    rx_capture.len == rx_capture.max)
 		return;
-	safe_udelay(length);
+	if (rx_capture.len == 0) {
+		if (!(l & PULSE_BIT))
+			return;
+		rx_capture.first_ns = end_ns -
+			(u64)(l & PULSE_MASK) * NSEC_PER_USEC;
+	}
+	rx_capture.buf[rx_capture.len++] = l;
+	if (rx_capture.len == rx_capture.want)
+		wake_up(&rx_capture_wait);
 }
 
-static void rbwrite(int l)
+/* end_ns is when the sample ended, the edge that closed it */
+static void rbwrite(int l, u64 end_ns)
 {
+	struct rx_stamp stamp;
+
+	if (rx_capture.active) {
+		rx_capture_add(l, end_ns);
+		return;
+	}
 	if (lirc_buffer_full(&rbuf)) {
 		/* no new signals will be accepted */
 		dprintk("Buffer overrun\n");
+		rx_overruns++;
 		return;
 	}
 	lirc_buffer_write(&rbuf, (void *)&l);
+	stamp.ns = end_ns;
+	stamp.sample = l;
+	kfifo_put(&rx_stamps, stamp);
 }
 
 static void frbwrite(int l)
@@ -234,12 +652,16 @@ static void frbwrite(int l)
 	/* simple noise filter */
 	static int pulse, space;
 	static unsigned int ptr;
+	/* when the held space or pulse ended, written out later */
+	static u64 held_ns;
 
 	if (ptr > 0 && (l & PULSE_BIT)) {
 		pulse += l & PULSE_MASK;
+		held_ns = rx_edge_ns;
 		if (pulse > 250) {
-			rbwrite(space);
-			rbwrite(pulse | PULSE_BIT);
+			rbwrite(space, held_ns -
+				(u64)pulse * NSEC_PER_USEC);
+			rbwrite(pulse | PULSE_BIT, held_ns);
 			ptr = 0;
 			pulse = 0;
 		}
@@ -249,6 +671,7 @@ static void frbwrite(int l)
 		if (ptr == 0) {
 			if (l > 20000) {
 				space = l;
+				held_ns = rx_edge_ns;
 				ptr++;
 				return;
 			}
@@ -260,70 +683,219 @@ static void frbwrite(int l)
 				space += l;
 				if (space > PULSE_MASK)
 					space = PULSE_MASK;
+				held_ns = rx_edge_ns;
 				pulse = 0;
 				return;
 			}
-			rbwrite(space);
-			rbwrite(pulse | PULSE_BIT);
+			rbwrite(space, held_ns - (u64)pulse * NSEC_PER_USEC);
+			rbwrite(pulse | PULSE_BIT, held_ns);
 			ptr = 0;
 			pulse = 0;
 		}
 	}
-	rbwrite(l);
+	rbwrite(l, rx_edge_ns);
 }
 
-static irqreturn_t irq_handler(int i, void *blah, struct pt_regs *regs)
+/*
+ * Turn one receiver edge into a pulse/space sample. tv is the time of
+ * the edge, last the time of the previous one; called with rx_lock held.
+ */
+static void rx_edge(int signal, struct timeval *tv, struct timeval *last)
 {
-	struct timeval tv;
 	long deltv;
 	int data;
-	int signal;
 
-	/* use the GPIO signal level */
-	signal = gpiochip->get(gpiochip, gpio_in_pin);
-
-	if (sense != -1) {
-		/* get current time */
-		do_gettimeofday(&tv);
-
-		/* calc time since last interrupt in microseconds */
-		deltv = tv.tv_sec-lasttv.tv_sec;
-		if (tv.tv_sec < lasttv.tv_sec ||
-		    (tv.tv_sec == lasttv.tv_sec &&
-		     tv.tv_usec < lasttv.tv_usec)) {
-			printk(KERN_WARNING LIRC_DRIVER_NAME
-			       ": AIEEEE: your clock just jumped backwards\n");
-			printk(KERN_WARNING LIRC_DRIVER_NAME
-			       ": %d %d %lx %lx %lx %lx\n", signal, sense,
-			       tv.tv_sec, lasttv.tv_sec,
-			       tv.tv_usec, lasttv.tv_usec);
-			data = PULSE_MASK;
-		} else if (deltv > 15) {
-			data = PULSE_MASK; /* really long time */
-			if (!(signal^sense)) {
-				/* sanity check */
-				printk(KERN_DEBUG LIRC_DRIVER_NAME
-				       ": AIEEEE: %d %d %lx %lx %lx %lx\n",
-				       signal, sense, tv.tv_sec, lasttv.tv_sec,
-				       tv.tv_usec, lasttv.tv_usec);
-				/*
-				 * detecting pulse while this
-				 * MUST be a space!
-				 */
-				sense = sense ? 0 : 1;
-			}
-		} else {
-			data = (int) (deltv*1000000 +
-				      (tv.tv_usec - lasttv.tv_usec));
+	/* calc time since last interrupt in microseconds */
+	deltv = tv->tv_sec-last->tv_sec;
+	if (tv->tv_sec < last->tv_sec ||
+	    (tv->tv_sec == last->tv_sec &&
+	     tv->tv_usec < last->tv_usec)) {
+		printk(KERN_WARNING LIRC_DRIVER_NAME
+		       ": AIEEEE: your clock just jumped backwards\n");
+		printk(KERN_WARNING LIRC_DRIVER_NAME
+		       ": %d %d %lx %lx %lx %lx\n", signal, sense,
+		       tv->tv_sec, last->tv_sec,
+		       tv->tv_usec, last->tv_usec);
+		data = PULSE_MASK;
+	} else if (deltv > 15) {
+		data = PULSE_MASK; /* really long time */
+		if (!(signal^sense)) {
+			/* sanity check */
+			printk(KERN_DEBUG LIRC_DRIVER_NAME
+			       ": AIEEEE: %d %d %lx %lx %lx %lx\n",
+			       signal, sense, tv->tv_sec, last->tv_sec,
+			       tv->tv_usec, last->tv_usec);
+			/*
+			 * detecting pulse while this
+			 * MUST be a space!
+			 */
+			sense = sense ? 0 : 1;
 		}
-		frbwrite(signal^sense ? data : (data|PULSE_BIT));
-		lasttv = tv;
-		wake_up_interruptible(&rbuf.wait_poll);
+	} else {
+		data = (int) (deltv*1000000 +
+			      (tv->tv_usec - last->tv_usec));
+	}
+	frbwrite(signal^sense ? data : (data|PULSE_BIT));
+	*last = *tv;
+}
+
+/*
+ * Only stamps the edge: it takes no locks, so it stays a hard handler
+ * under threadirqs and PREEMPT_RT without sleeping in hard IRQ context.
+ */
+static irqreturn_t irq_handler(int i, void *blah, struct pt_regs *regs)
+{
+	struct rx_hw_edge e;
+
+	e.ns = ktime_get_ns();
+	/* use the GPIO signal level */
+	e.signal = gpiochip->get(gpiochip, gpio_in_pin);
+
+	if (sense == -1)
+		return IRQ_HANDLED;
+	if (!kfifo_put(&rx_hw_edges, e))
+		rx_hw_edges_lost++;
+	return IRQ_WAKE_THREAD;
+}
+
+static void ns_to_tv(u64 ns, struct timeval *tv)
+{
+	u32 rem;
+
+	tv->tv_sec = div_u64_rem(ns, NSEC_PER_SEC, &rem);
+	tv->tv_usec = rem / NSEC_PER_USEC;
+}
+
+/* called by the IRQ thread on itself, so from process context */
+static void irq_thread_sched(void)
+{
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+	int policy = READ_ONCE(irq_thread_policy);
+
+	/* -1 puts back what the kernel gives every IRQ thread */
+	if (policy == -1)
+		policy = SCHED_FIFO;
+	else
+		param.sched_priority = policy == SCHED_NORMAL ?
+			0 : READ_ONCE(irq_thread_prio);
+	if (sched_setscheduler_nocheck(current, policy, &param))
+		printk(KERN_WARNING LIRC_DRIVER_NAME
+		       ": failed to set IRQ thread policy %d prio %d\n",
+		       policy, param.sched_priority);
+}
+
+/*
+ * Runs in the kernel's irq/N-lirc_tegra thread: turns the edges queued
+ * by irq_handler() into samples and wakes readers.
+ */
+static irqreturn_t irq_thread_fn(int irq, void *dev_id)
+{
+	struct rx_hw_edge e;
+	struct timeval tv;
+	unsigned long flags;
+	int gen = atomic_read(&irq_sched_gen);
+
+	if (gen != irq_sched_applied) {
+		irq_sched_applied = gen;
+		irq_thread_sched();
 	}
 
+	while (kfifo_get(&rx_hw_edges, &e)) {
+		ns_to_tv(e.ns, &tv);
+		spin_lock_irqsave(&rx_lock, flags);
+		rx_edge_ns = e.ns;
+		rx_edge(e.signal, &tv, &lasttv);
+		spin_unlock_irqrestore(&rx_lock, flags);
+	}
+	rx_irq_cpu = raw_smp_processor_id();
+	wake_up_interruptible(&rbuf.wait_poll);
 	return IRQ_HANDLED;
 }
 
+static void rx_inject_edge(int signal, u64 t, struct timeval *last)
+{
+	struct timeval tv;
+	unsigned long flags;
+
+	ns_to_tv(t, &tv);
+	spin_lock_irqsave(&rx_lock, flags);
+	rx_edge_ns = ktime_get_ns();
+	rx_edge(signal, &tv, last);
+	spin_unlock_irqrestore(&rx_lock, flags);
+	rx_inject_stats.edges++;
+}
+
+/*
+ * Replay a pulse/space stream (the same int format as read() returns)
+ * through the receive path, as if each sample had ended with an edge
+ * on gpio_in_pin. Edges are perturbed by the rx_inject_* knobs.
+ * Nothing is paced: the samples land in rbuf at once, so a write of
+ * more than fits there loses the rest unless a reader keeps up.
+ */
+static ssize_t rx_inject_write(struct file *file, const char __user *buf,
+			       size_t n, loff_t *ppos)
+{
+	struct timeval last;
+	int *samples;
+	int i, count, signal;
+	u64 ideal, t, prev, glitch, width, start_ns;
+
+	if (n % sizeof(int))
+		return -EINVAL;
+	if (sense == -1)
+		return -ENODEV;
+	count = n / sizeof(int);
+	samples = memdup_user(buf, n);
+	if (IS_ERR(samples))
+		return PTR_ERR(samples);
+
+	mutex_lock(&rx_inject_mutex);
+	start_ns = ktime_get_ns();
+	do_gettimeofday(&last);
+	ideal = prev = timeval_to_ns(&last);
+	for (i = 0; i < count; i++) {
+		/* the edge ending a pulse goes back to the idle level */
+		signal = samples[i] & PULSE_BIT ? sense : !sense;
+		ideal += (u64)(samples[i] & PULSE_MASK) * NSEC_PER_USEC;
+
+		if (rx_inject_drop_permille &&
+		    prandom_u32_max(1000) < rx_inject_drop_permille) {
+			rx_inject_stats.dropped++;
+			continue;
+		}
+
+		t = ideal;
+		if (rx_inject_jitter_us) {
+			t += (u64)prandom_u32_max(2 * rx_inject_jitter_us + 1)
+				* NSEC_PER_USEC;
+			t -= (u64)rx_inject_jitter_us * NSEC_PER_USEC;
+		}
+		if (t <= prev)
+			t = prev + NSEC_PER_USEC;
+
+		/* a short excursion to the level the sample ends with */
+		if (rx_inject_glitch_permille && rx_inject_glitch_us &&
+		    t - prev > 2 * NSEC_PER_USEC &&
+		    prandom_u32_max(1000) < rx_inject_glitch_permille) {
+			glitch = prev + (t - prev) / 2;
+			width = min_t(u64,
+				      (u64)rx_inject_glitch_us * NSEC_PER_USEC,
+				      t - glitch - NSEC_PER_USEC);
+			rx_inject_edge(signal, glitch, &last);
+			rx_inject_edge(!signal, glitch + width, &last);
+			rx_inject_stats.glitches++;
+		}
+		rx_inject_edge(signal, t, &last);
+		prev = t;
+	}
+	rx_inject_stats.ns += ktime_get_ns() - start_ns;
+	mutex_unlock(&rx_inject_mutex);
+
+	wake_up_interruptible(&rbuf.wait_poll);
+	kfree(samples);
+	return n;
+}
+
 static int is_right_chip(struct gpio_chip *chip, void *data)
 {
 	dprintk("is_right_chip %s %d\n", chip->label, strcmp(data, chip->label));
@@ -456,26 +1028,55 @@ static int init_port(void)
 	return 0;
 }
 
+/* called with irq_cfg_mutex held */
+static void apply_irq_affinity(void)
+{
+	if (!irq_held)
+		return;
+	if (irq_set_affinity_hint(irq_num,
+				  irq_cpu >= 0 ? cpumask_of(irq_cpu) : NULL))
+		printk(KERN_WARNING LIRC_DRIVER_NAME
+		       ": cannot route IRQ %d to CPU %d\n", irq_num, irq_cpu);
+}
+
 // called when the character device is opened
 static int set_use_inc(void *data)
 {
 	int result;
 
-	/* initialize timestamp */
-	do_gettimeofday(&lasttv);
-
-	result = request_irq(irq_num,
-			     (irq_handler_t) irq_handler,
-			     IRQ_TYPE_EDGE_RISING | IRQ_TYPE_EDGE_FALLING,
-			     LIRC_DRIVER_NAME, (void*) 0);
+	/* initialize timestamp, on the clock edges are stamped with */
+	ns_to_tv(ktime_get_ns(), &lasttv);
+	/* edges left over from the last time the IRQ was held */
+	kfifo_reset(&rx_hw_edges);
+
+	/* lirc_dev has just cleared rbuf, drop the matching stamps */
+	mutex_lock(&rx_read_mutex);
+	spin_lock_irq(&rx_lock);
+	kfifo_reset(&rx_stamps);
+	spin_unlock_irq(&rx_lock);
+	mutex_unlock(&rx_read_mutex);
+	mutex_lock(&rxlat_mutex);
+	rxlat.pending = false;
+	mutex_unlock(&rxlat_mutex);
+
+	mutex_lock(&irq_cfg_mutex);
+	/* the edge is stamped in hard IRQ context even with threadirqs */
+	result = request_threaded_irq(irq_num,
+				      (irq_handler_t) irq_handler,
+				      irq_thread_fn,
+				      IRQ_TYPE_EDGE_RISING |
+				      IRQ_TYPE_EDGE_FALLING | IRQF_NO_THREAD,
+				      LIRC_DRIVER_NAME, (void*) 0);
 
 	switch (result) {
 	case -EBUSY:
+		mutex_unlock(&irq_cfg_mutex);
 		printk(KERN_ERR LIRC_DRIVER_NAME
 		       ": IRQ %d is busy\n",
 		       irq_num);
 		return -EBUSY;
 	case -EINVAL:
+		mutex_unlock(&irq_cfg_mutex);
 		printk(KERN_ERR LIRC_DRIVER_NAME
 		       ": Bad irq number or handler\n");
 		return -EINVAL;
@@ -485,6 +1086,13 @@ static int set_use_inc(void *data)
 		break;
 	};
 
+	/* a fresh request_irq() means a fresh thread and default affinity */
+	irq_held = true;
+	apply_irq_affinity();
+	/* the new thread applies the policy before its first edge */
+	irq_sched_applied = atomic_read(&irq_sched_gen) - 1;
+	mutex_unlock(&irq_cfg_mutex);
+
 	/* initialize pulse/space widths */
 	init_timing_params(duty_cycle, freq);
 
@@ -497,18 +1105,84 @@ static void set_use_dec(void *data)
 	irq_set_irq_type(irq_num, 0);
 	disable_irq(irq_num);
 
+	mutex_lock(&irq_cfg_mutex);
+	irq_held = false;
+	irq_set_affinity_hint(irq_num, NULL);
 	free_irq(irq_num, (void *) 0);
+	mutex_unlock(&irq_cfg_mutex);
 
 	dprintk(KERN_INFO LIRC_DRIVER_NAME
 		": freed IRQ %d\n", irq_num);
 }
 
+/* called with rx_capture_mutex held, nothing is captured until armed */
+static void rx_capture_setup(int *buf, unsigned int max)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rx_lock, flags);
+	rx_capture.buf = buf;
+	rx_capture.len = 0;
+	rx_capture.max = max;
+	rx_capture.want = max;
+	spin_unlock_irqrestore(&rx_lock, flags);
+}
+
+/* called with rx_capture_mutex held, after rx_capture_setup() */
+static void rx_capture_arm(u64 start_ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rx_lock, flags);
+	rx_capture.start_ns = start_ns;
+	rx_capture.active = true;
+	spin_unlock_irqrestore(&rx_lock, flags);
+}
+
+static void rx_capture_disarm(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rx_lock, flags);
+	rx_capture.active = false;
+	spin_unlock_irqrestore(&rx_lock, flags);
+}
+
+/*
+ * carrier = false drives the outputs directly even with softcarrier on.
+ * capture = true arms the capture set up by the caller right before the
+ * frame goes out, so that its echo does not reach rbuf.
+ */
+static int tx_send(const int *wbuf, int count, bool carrier, bool capture)
+{
+	int result;
+	unsigned long flags;
+	struct tx_table *table;
+
+	/* back off before taking a table, so the other writer can use it */
+	result = tx_listen();
+	if (result)
+		return result;
+	table = tx_table_get();
+	if (IS_ERR(table))
+		return PTR_ERR(table);
+	result = tx_compile(table, wbuf, count, carrier);
+	if (!result) {
+		/* keep everything until rx_capture.start_ns is set */
+		if (capture)
+			rx_capture_arm(U64_MAX);
+		spin_lock_irqsave(&lock, flags);
+		tx_replay(table);
+		spin_unlock_irqrestore(&lock, flags);
+	}
+	tx_table_put(table);
+	return result;
+}
+
 static ssize_t lirc_write(struct file *file, const char *buf,
 	size_t n, loff_t *ppos)
 {
-	int i, count;
-	unsigned long flags;
-	long delta = 0;
+	int count, result;
 	int *wbuf;
 
 	count = n / sizeof(int);
@@ -517,22 +1191,410 @@ static ssize_t lirc_write(struct file *file, const char *buf,
 	wbuf = memdup_user(buf, n);
 	if (IS_ERR(wbuf))
 		return PTR_ERR(wbuf);
-	spin_lock_irqsave(&lock, flags);
 
+	result = tx_send(wbuf, count, true, false);
+	kfree(wbuf);
+	return result ? result : n;
+}
+
+static unsigned int rx_capture_count(void)
+{
+	unsigned long flags;
+	unsigned int len;
+
+	spin_lock_irqsave(&rx_lock, flags);
+	len = rx_capture.len;
+	spin_unlock_irqrestore(&rx_lock, flags);
+	return len;
+}
+
+/* wait until want samples are captured or ktime_get_ns() passes deadline */
+static int rx_capture_wait_for(unsigned int want, u64 deadline)
+{
+	unsigned long flags;
+	long left;
+	u64 now;
+
+	spin_lock_irqsave(&rx_lock, flags);
+	rx_capture.want = want;
+	spin_unlock_irqrestore(&rx_lock, flags);
+
+	now = ktime_get_ns();
+	if (now >= deadline)
+		return rx_capture_count() >= want ? 0 : -ETIMEDOUT;
+	left = wait_event_interruptible_timeout(rx_capture_wait,
+						rx_capture_count() >= want,
+						nsecs_to_jiffies(deadline - now));
+	if (left < 0)
+		return -ERESTARTSYS;
+	return left ? 0 : -ETIMEDOUT;
+}
+
+static int match_template(const int *rx, unsigned int rx_count,
+			  const int *tpl, unsigned int count,
+			  unsigned int tolerance)
+{
+	unsigned int i;
+	int want, got;
+
+	if (rx_count < count)
+		return 0;
 	for (i = 0; i < count; i++) {
-		if (i%2)
-			send_space(wbuf[i] - delta);
-		else
-			delta = send_pulse(wbuf[i]);
+		if ((rx[i] ^ tpl[i]) & PULSE_BIT)
+			return 0;
+		want = tpl[i] & PULSE_MASK;
+		got = rx[i] & PULSE_MASK;
+		if ((s64)abs(got - want) * 100 > (s64)want * tolerance)
+			return 0;
 	}
-	for (i = 0; i < n_transmitters; i++)
-		gpiochip->set(gpiochip, gpio_out_pin[i], invert);
+	return 1;
+}
 
-	spin_unlock_irqrestore(&lock, flags);
-	kfree(wbuf);
+/* send a frame and capture the response without a trip through rbuf */
+static int lirc_transact(struct lirc_tegra_transact __user *arg)
+{
+	struct lirc_tegra_transact t;
+	int *tx = NULL, *rx = NULL, *tpl = NULL;
+	unsigned long flags;
+	u64 end = 0;
+	int result;
+
+	if (copy_from_user(&t, arg, sizeof(t)))
+		return -EFAULT;
+	if (t.tx_count % 2 == 0 || t.tx_count > TX_MAX_STEPS ||
+	    !t.rx_max || t.rx_max > LIRC_TEGRA_TRANSACT_MAX ||
+	    t.match_count > LIRC_TEGRA_TRANSACT_MAX ||
+	    t.timeout_us > LIRC_TEGRA_TIMEOUT_MAX_US)
+		return -EINVAL;
+	if (gpio_in_pin == INVALID || sense == -1)
+		return -ENODEV;
+
+	tx = memdup_user(u64_to_user_ptr(t.tx_buf), t.tx_count * sizeof(int));
+	if (IS_ERR(tx))
+		return PTR_ERR(tx);
+	if (t.match_buf && t.match_count) {
+		tpl = memdup_user(u64_to_user_ptr(t.match_buf),
+				  t.match_count * sizeof(int));
+		if (IS_ERR(tpl)) {
+			result = PTR_ERR(tpl);
+			tpl = NULL;
+			goto out;
+		}
+	}
+	rx = kmalloc_array(t.rx_max, sizeof(int), GFP_KERNEL);
+	if (!rx) {
+		result = -ENOMEM;
+		goto out;
+	}
+
+	if (mutex_lock_interruptible(&rx_capture_mutex)) {
+		result = -ERESTARTSYS;
+		goto out;
+	}
+	/* armed by tx_send(), but nothing is kept until the frame is out */
+	rx_capture_setup(rx, t.rx_max);
+
+	result = tx_send(tx, t.tx_count, true, true);
+	if (!result) {
+		end = READ_ONCE(tx_end_ns);
+		spin_lock_irqsave(&rx_lock, flags);
+		rx_capture.start_ns = end + (u64)t.holdoff_us * NSEC_PER_USEC;
+		spin_unlock_irqrestore(&rx_lock, flags);
+
+		result = rx_capture_wait_for(t.rx_max, end +
+					     (u64)t.timeout_us * NSEC_PER_USEC);
+		/* running out of time just means a short or no response */
+		if (result == -ETIMEDOUT)
+			result = 0;
+		/* the frame is out, restarting would send it again */
+		if (result == -ERESTARTSYS)
+			result = -EINTR;
+	}
+
+	rx_capture_disarm();
+	spin_lock_irqsave(&rx_lock, flags);
+	t.rx_count = rx_capture.len;
+	t.response_ns = t.rx_count && rx_capture.first_ns > end ?
+		rx_capture.first_ns - end : 0;
+	spin_unlock_irqrestore(&rx_lock, flags);
+	mutex_unlock(&rx_capture_mutex);
+	if (result)
+		goto out;
+
+	t.match_result = tpl ? match_template(rx, t.rx_count, tpl,
+					      t.match_count,
+					      t.match_tolerance) : -1;
+	if (copy_to_user(u64_to_user_ptr(t.rx_buf), rx,
+			 t.rx_count * sizeof(int)) ||
+	    copy_to_user(arg, &t, sizeof(t)))
+		result = -EFAULT;
+out:
+	kfree(rx);
+	kfree(tpl);
+	kfree(tx);
+	return result;
+}
+
+static unsigned int link_put_byte(int *out, unsigned int n, u8 byte)
+{
+	int bit;
+
+	for (bit = 7; bit >= 0; bit--) {
+		out[n++] = link_unit_us;
+		out[n++] = (byte >> bit & 1 ? 2 : 1) * link_unit_us;
+	}
 	return n;
 }
 
+/*
+ * Encode a data link frame as carrierless pulse/spaces: a 4 unit mark and
+ * 2 unit space, then every bit of length, fragment byte, payload and crc
+ * as a 1 unit mark followed by a 1 (zero) or 2 (one) unit space, then a
+ * closing mark.
+ */
+static unsigned int link_encode(const u8 *data, unsigned int len, u8 frag,
+				int *out)
+{
+	unsigned int i, n = 0;
+	u16 crc;
+	u8 hdr[2] = { len, frag };
+
+	out[n++] = 4 * link_unit_us;
+	out[n++] = 2 * link_unit_us;
+	n = link_put_byte(out, n, hdr[0]);
+	n = link_put_byte(out, n, hdr[1]);
+	for (i = 0; i < len; i++)
+		n = link_put_byte(out, n, data[i]);
+	crc = crc_ccitt(crc_ccitt(0xffff, hdr, sizeof(hdr)), data, len);
+	n = link_put_byte(out, n, crc >> 8);
+	n = link_put_byte(out, n, crc & 0xff);
+	out[n++] = link_unit_us;
+	return n;
+}
+
+static unsigned int link_units(int sample)
+{
+	return DIV_ROUND_CLOSEST(sample & PULSE_MASK, link_unit_us);
+}
+
+/*
+ * Decode a captured data link frame into out, which has room for max
+ * bytes, and its fragment byte into *frag. Returns the payload length,
+ * -EAGAIN with *need set when more samples are required, -EBADMSG, or
+ * -EMSGSIZE with *need set to the payload length as soon as the length
+ * byte shows it will not fit.
+ */
+static int link_decode(const int *s, unsigned int n, u8 *out,
+		       unsigned int max, u8 *frag, unsigned int *need)
+{
+	u8 bytes[LIRC_TEGRA_LINK_MAX + 4];
+	unsigned int i, bit, nbytes = 1;
+	u16 crc;
+
+	*need = 2 + 16;
+	if (n < *need)
+		return -EAGAIN;
+	if (!(s[0] & PULSE_BIT) || link_units(s[0]) != 4 ||
+	    s[1] & PULSE_BIT || link_units(s[1]) != 2)
+		return -EBADMSG;
+
+	memset(bytes, 0, sizeof(bytes));
+	for (bit = 0; bit < nbytes * 8; bit++) {
+		i = 2 + 2 * bit;
+		if (i + 2 > n) {
+			*need = 2 + 16 * nbytes;
+			return -EAGAIN;
+		}
+		if (!(s[i] & PULSE_BIT) || link_units(s[i]) != 1 ||
+		    s[i + 1] & PULSE_BIT)
+			return -EBADMSG;
+		switch (link_units(s[i + 1])) {
+		case 1:
+			break;
+		case 2:
+			bytes[bit / 8] |= 0x80 >> bit % 8;
+			break;
+		default:
+			return -EBADMSG;
+		}
+		if (bit == 7) {
+			if (bytes[0] > LIRC_TEGRA_LINK_MAX)
+				return -EBADMSG;
+			if (bytes[0] > max) {
+				*need = bytes[0];
+				return -EMSGSIZE;
+			}
+			nbytes = bytes[0] + 4;
+		}
+	}
+
+	crc = crc_ccitt(0xffff, bytes, nbytes - 2);
+	if (crc != (bytes[nbytes - 2] << 8 | bytes[nbytes - 1]))
+		return -EBADMSG;
+	*frag = bytes[1];
+	memcpy(out, bytes + 2, bytes[0]);
+	return bytes[0];
+}
+
+static int lirc_link_send(struct lirc_tegra_link __user *arg)
+{
+	struct lirc_tegra_link l;
+	unsigned int count;
+	int *samples;
+	u8 *data;
+	u64 start;
+	int result;
+
+	if (copy_from_user(&l, arg, sizeof(l)))
+		return -EFAULT;
+	if (!l.len || l.len > LIRC_TEGRA_LINK_MAX ||
+	    l.frag & ~(LIRC_TEGRA_LINK_SEQ | LIRC_TEGRA_LINK_LAST) ||
+	    link_unit_us < LINK_MIN_UNIT_US)
+		return -EINVAL;
+
+	data = memdup_user(u64_to_user_ptr(l.buf), l.len);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+	samples = kmalloc_array(LINK_MAX_SAMPLES, sizeof(int), GFP_KERNEL);
+	if (!samples) {
+		kfree(data);
+		return -ENOMEM;
+	}
+	count = link_encode(data, l.len, l.frag, samples);
+
+	start = ktime_get_ns();
+	result = tx_send(samples, count, false, false);
+	if (!result) {
+		mutex_lock(&link_mutex);
+		link_stats.tx_bytes += l.len;
+		link_stats.tx_ns += ktime_get_ns() - start;
+		mutex_unlock(&link_mutex);
+	}
+	kfree(samples);
+	kfree(data);
+	return result;
+}
+
+static int lirc_link_recv(struct lirc_tegra_link __user *arg)
+{
+	struct lirc_tegra_link l;
+	u8 payload[LIRC_TEGRA_LINK_MAX], frag;
+	unsigned int need = 2 + 16;
+	int *samples;
+	u64 deadline, first_ns;
+	int result;
+
+	if (copy_from_user(&l, arg, sizeof(l)))
+		return -EFAULT;
+	if (!l.len || l.timeout_us > LIRC_TEGRA_TIMEOUT_MAX_US ||
+	    link_unit_us < LINK_MIN_UNIT_US)
+		return -EINVAL;
+	if (gpio_in_pin == INVALID || sense == -1)
+		return -ENODEV;
+	samples = kmalloc_array(LINK_MAX_SAMPLES, sizeof(int), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	if (mutex_lock_interruptible(&rx_capture_mutex)) {
+		kfree(samples);
+		return -ERESTARTSYS;
+	}
+	deadline = ktime_get_ns() + (u64)l.timeout_us * NSEC_PER_USEC;
+	rx_capture_setup(samples, LINK_MAX_SAMPLES);
+	rx_capture_arm(0);
+	do {
+		result = rx_capture_wait_for(need, deadline);
+		if (result)
+			break;
+		result = link_decode(samples, rx_capture_count(), payload,
+				     min_t(u32, l.len, LIRC_TEGRA_LINK_MAX),
+				     &frag, &need);
+	} while (result == -EAGAIN);
+	rx_capture_disarm();
+	first_ns = rx_capture.first_ns;
+	mutex_unlock(&rx_capture_mutex);
+
+	mutex_lock(&link_mutex);
+	if (result >= 0) {
+		link_stats.rx_bytes += result;
+		link_stats.rx_ns += ktime_get_ns() - first_ns;
+	} else if (result == -EBADMSG) {
+		link_stats.rx_errors++;
+	}
+	mutex_unlock(&link_mutex);
+	kfree(samples);
+	if (result == -EMSGSIZE) {
+		/* tell the caller how much room the frame needed */
+		l.len = need;
+		if (copy_to_user(arg, &l, sizeof(l)))
+			return -EFAULT;
+	}
+	if (result < 0)
+		return result;
+
+	l.len = result;
+	l.frag = frag;
+	if (copy_to_user(u64_to_user_ptr(l.buf), payload, l.len) ||
+	    copy_to_user(arg, &l, sizeof(l)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Called with rxlat_mutex held for each sample handed to userspace. The
+ * last pulse of a frame is only known once the following long space is
+ * read, so its latency is kept pending until then.
+ */
+static void rxlat_account(struct rx_stamp *stamp, u64 now)
+{
+	u64 lat;
+
+	if (stamp->sample & PULSE_BIT) {
+		rxlat.pending_ns = now > stamp->ns ? now - stamp->ns : 0;
+		rxlat.pending = true;
+		return;
+	}
+	if (!rxlat.pending || (stamp->sample & PULSE_MASK) < RX_FRAME_GAP)
+		return;
+
+	lat = rxlat.pending_ns;
+	rxlat.pending = false;
+	rxlat.hist[min_t(unsigned int, fls64(lat / NSEC_PER_USEC),
+			 RXLAT_BUCKETS - 1)]++;
+	if (!rxlat.frames || lat < rxlat.min_ns)
+		rxlat.min_ns = lat;
+	if (lat > rxlat.max_ns)
+		rxlat.max_ns = lat;
+	rxlat.total_ns += lat;
+	rxlat.frames++;
+}
+
+static ssize_t lirc_read(struct file *file, char __user *buf,
+	size_t n, loff_t *ppos)
+{
+	struct rx_stamp stamp;
+	ssize_t ret;
+	u64 now;
+	int i;
+
+	if (mutex_lock_interruptible(&rx_read_mutex))
+		return -ERESTARTSYS;
+	ret = lirc_dev_fop_read(file, buf, n, ppos);
+	if (ret > 0) {
+		now = ktime_get_ns();
+		mutex_lock(&rxlat_mutex);
+		for (i = 0; i < ret / sizeof(int); i++)
+			if (kfifo_get(&rx_stamps, &stamp))
+				rxlat_account(&stamp, now);
+		mutex_unlock(&rxlat_mutex);
+		rx_reads++;
+		if (raw_smp_processor_id() != READ_ONCE(rx_irq_cpu))
+			rx_xcpu_wakeups++;
+	}
+	mutex_unlock(&rx_read_mutex);
+	return ret;
+}
+
 static long lirc_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 {
 	int result;
@@ -589,6 +1651,18 @@ static long lirc_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		tx_mask = value;
 		break;
 
+	case LIRC_TEGRA_TRANSACT:
+		dprintk("LIRC_TEGRA_TRANSACT\n");
+		return lirc_transact((struct lirc_tegra_transact __user *)arg);
+
+	case LIRC_TEGRA_LINK_SEND:
+		dprintk("LIRC_TEGRA_LINK_SEND\n");
+		return lirc_link_send((struct lirc_tegra_link __user *)arg);
+
+	case LIRC_TEGRA_LINK_RECV:
+		dprintk("LIRC_TEGRA_LINK_RECV\n");
+		return lirc_link_recv((struct lirc_tegra_link __user *)arg);
+
 	default:
 		dprintk("COMMAND handed over to lirc_dev_fop_ioctl: %u\n", cmd);
 		return lirc_dev_fop_ioctl(filep, cmd, arg);
@@ -600,7 +1674,7 @@ static const struct file_operations lirc_fops = {
 	.owner		= THIS_MODULE,
 	.write		= lirc_write,
 	.unlocked_ioctl	= lirc_ioctl,
-	.read		= lirc_dev_fop_read,
+	.read		= lirc_read,
 	.poll		= lirc_dev_fop_poll,
 	.open		= lirc_dev_fop_open,
 	.release	= lirc_dev_fop_close,
@@ -622,6 +1696,324 @@ static struct lirc_driver driver = {
 	.owner		= THIS_MODULE,
 };
 
+/* debugfs file showing name##_show() */
+#define DEBUGFS_SHOW_FOPS(name)						\
+static int name##_open(struct inode *inode, struct file *file)		\
+{									\
+	return single_open(file, name##_show, NULL);			\
+}									\
+									\
+static const struct file_operations name##_fops = {			\
+	.owner		= THIS_MODULE,					\
+	.open		= name##_open,					\
+	.read		= seq_read,					\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
+
+/* statistics shown by name##_show(), any write calls name##_reset() */
+#define DEBUGFS_STATS_FOPS(name)					\
+static int name##_open(struct inode *inode, struct file *file)		\
+{									\
+	return single_open(file, name##_show, NULL);			\
+}									\
+									\
+static ssize_t name##_write(struct file *file, const char __user *buf,	\
+			    size_t n, loff_t *ppos)			\
+{									\
+	name##_reset();							\
+	return n;							\
+}									\
+									\
+static const struct file_operations name##_fops = {			\
+	.owner		= THIS_MODULE,					\
+	.open		= name##_open,					\
+	.read		= seq_read,					\
+	.write		= name##_write,					\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
+
+static int txlog_frames_show(struct seq_file *m, void *unused)
+{
+	struct txlog_frame *snap;
+	unsigned long flags;
+	unsigned int head, i;
+
+	snap = kmalloc(sizeof(txlog_frames), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+	spin_lock_irqsave(&lock, flags);
+	memcpy(snap, txlog_frames, sizeof(txlog_frames));
+	head = txlog_frame_head;
+	spin_unlock_irqrestore(&lock, flags);
+
+	seq_puts(m, "# frame start_ns edges overshoot_ns max_err_ns\n");
+	for (i = head > TXLOG_FRAMES ? head - TXLOG_FRAMES : 0; i < head; i++) {
+		struct txlog_frame *f = &snap[i % TXLOG_FRAMES];
+
+		seq_printf(m, "%u %llu %u %d %u\n", f->seq,
+			   (unsigned long long)f->start_ns, f->edges,
+			   f->overshoot, f->max_err);
+	}
+	kfree(snap);
+	return 0;
+}
+
+static int txlog_edges_show(struct seq_file *m, void *unused)
+{
+	struct txlog_edge *snap;
+	unsigned long flags;
+	unsigned int head, i;
+
+	snap = kmalloc(sizeof(txlog_edges), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+	spin_lock_irqsave(&lock, flags);
+	memcpy(snap, txlog_edges, sizeof(txlog_edges));
+	head = txlog_edge_head;
+	spin_unlock_irqrestore(&lock, flags);
+
+	seq_puts(m, "# frame level target_ns actual_ns error_ns\n");
+	for (i = head > TXLOG_EDGES ? head - TXLOG_EDGES : 0; i < head; i++) {
+		struct txlog_edge *e = &snap[i % TXLOG_EDGES];
+
+		seq_printf(m, "%u %u %llu %llu %lld\n", e->frame, e->level,
+			   (unsigned long long)e->target,
+			   (unsigned long long)e->actual,
+			   (long long)(e->actual - e->target));
+	}
+	kfree(snap);
+	return 0;
+}
+
+static unsigned int txstats_percentile(const u32 *hist, u64 total,
+				       unsigned int permille)
+{
+	u64 seen = 0, want = div_u64(total * permille + 999, 1000);
+	unsigned int i;
+
+	for (i = 0; i < TXSTATS_BUCKETS - 1; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			break;
+	}
+	return i + 1;
+}
+
+static int txstats_show(struct seq_file *m, void *unused)
+{
+	static const unsigned int permille[] = { 500, 900, 990, 999 };
+	unsigned long flags;
+	unsigned int i;
+	u32 *hist;
+	u64 edges, frames, irqoff_total, c_target, c_actual, c_halves;
+	u32 err_max, irqoff_max;
+
+	hist = kmalloc(sizeof(txstats.err_hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+	spin_lock_irqsave(&lock, flags);
+	memcpy(hist, txstats.err_hist, sizeof(txstats.err_hist));
+	edges = txstats.edges;
+	err_max = txstats.err_max;
+	c_target = txstats.carrier_target_ns;
+	c_actual = txstats.carrier_actual_ns;
+	c_halves = txstats.carrier_halves;
+	frames = txstats.frames;
+	irqoff_total = txstats.irqoff_total_ns;
+	irqoff_max = txstats.irqoff_max_ns;
+	spin_unlock_irqrestore(&lock, flags);
+
+	seq_printf(m, "edges: %llu\n", (unsigned long long)edges);
+	if (edges) {
+		for (i = 0; i < ARRAY_SIZE(permille); i++)
+			seq_printf(m, "edge_error_p%u.%u_us: <= %u\n",
+				   permille[i] / 10, permille[i] % 10,
+				   txstats_percentile(hist, edges, permille[i]));
+		seq_printf(m, "edge_error_max_ns: %u\n", err_max);
+	}
+	seq_printf(m, "carrier_halves: %llu\n", (unsigned long long)c_halves);
+	if (c_target && c_actual && freq) {
+		seq_printf(m, "carrier_nominal_hz: %u\n", freq);
+		seq_printf(m, "carrier_measured_hz: %llu\n",
+			   div64_u64((u64)freq * c_target, c_actual));
+		/* frequency error, so a short period reads as positive */
+		seq_printf(m, "carrier_error_ppm: %lld\n",
+			   div64_s64(((s64)c_target - (s64)c_actual) * 1000000,
+				     c_actual));
+	}
+	seq_printf(m, "frames: %llu\n", (unsigned long long)frames);
+	seq_printf(m, "lock_irqoff_total_ns: %llu\n",
+		   (unsigned long long)irqoff_total);
+	seq_printf(m, "lock_irqoff_max_ns: %u\n", irqoff_max);
+	kfree(hist);
+	return 0;
+}
+
+DEBUGFS_SHOW_FOPS(txlog_frames);
+DEBUGFS_SHOW_FOPS(txlog_edges);
+
+static void txstats_reset(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lock, flags);
+	memset(&txstats, 0, sizeof(txstats));
+	spin_unlock_irqrestore(&lock, flags);
+}
+
+DEBUGFS_STATS_FOPS(txstats);
+
+static int rx_inject_stats_show(struct seq_file *m, void *unused)
+{
+	u64 edges, ns;
+
+	mutex_lock(&rx_inject_mutex);
+	edges = rx_inject_stats.edges;
+	ns = rx_inject_stats.ns;
+	seq_printf(m, "edges: %llu\n", (unsigned long long)edges);
+	seq_printf(m, "glitches: %llu\n",
+		   (unsigned long long)rx_inject_stats.glitches);
+	seq_printf(m, "dropped: %llu\n",
+		   (unsigned long long)rx_inject_stats.dropped);
+	seq_printf(m, "overruns: %llu\n", (unsigned long long)rx_overruns);
+	seq_printf(m, "time_ns: %llu\n", (unsigned long long)ns);
+	if (ns)
+		seq_printf(m, "edges_per_sec: %llu\n",
+			   div64_u64(edges * NSEC_PER_SEC, ns));
+	mutex_unlock(&rx_inject_mutex);
+	return 0;
+}
+
+static void rx_inject_stats_reset(void)
+{
+	mutex_lock(&rx_inject_mutex);
+	memset(&rx_inject_stats, 0, sizeof(rx_inject_stats));
+	rx_overruns = 0;
+	mutex_unlock(&rx_inject_mutex);
+}
+
+DEBUGFS_STATS_FOPS(rx_inject_stats);
+
+static int rxlat_show(struct seq_file *m, void *unused)
+{
+	static const unsigned int permille[] = { 500, 900, 990 };
+	u64 seen, want;
+	unsigned int i, j;
+
+	mutex_lock(&rxlat_mutex);
+	seq_printf(m, "frames: %llu\n", (unsigned long long)rxlat.frames);
+	if (rxlat.frames) {
+		seq_printf(m, "min_us: %llu\n",
+			   div_u64(rxlat.min_ns, NSEC_PER_USEC));
+		seq_printf(m, "mean_us: %llu\n",
+			   div64_u64(rxlat.total_ns,
+				     rxlat.frames * NSEC_PER_USEC));
+		seq_printf(m, "max_us: %llu\n",
+			   div_u64(rxlat.max_ns, NSEC_PER_USEC));
+		for (i = 0; i < ARRAY_SIZE(permille); i++) {
+			want = div_u64(rxlat.frames * permille[i] + 999, 1000);
+			seen = 0;
+			for (j = 0; j < RXLAT_BUCKETS - 1; j++) {
+				seen += rxlat.hist[j];
+				if (seen >= want)
+					break;
+			}
+			seq_printf(m, "p%u_us: < %u\n", permille[i] / 10,
+				   1U << j);
+		}
+	}
+	seq_puts(m, "# bucket_us frames\n");
+	for (i = 0; i < RXLAT_BUCKETS; i++)
+		if (rxlat.hist[i])
+			seq_printf(m, "%u %u\n", i ? 1U << (i - 1) : 0,
+				   rxlat.hist[i]);
+	mutex_unlock(&rxlat_mutex);
+	return 0;
+}
+
+static void rxlat_reset(void)
+{
+	mutex_lock(&rxlat_mutex);
+	memset(&rxlat, 0, sizeof(rxlat));
+	mutex_unlock(&rxlat_mutex);
+}
+
+DEBUGFS_STATS_FOPS(rxlat);
+
+static int link_stats_show(struct seq_file *m, void *unused)
+{
+	mutex_lock(&link_mutex);
+	seq_printf(m, "tx_bytes: %llu\n", (unsigned long long)link_stats.tx_bytes);
+	if (link_stats.tx_ns)
+		seq_printf(m, "tx_bytes_per_sec: %llu\n",
+			   div64_u64(link_stats.tx_bytes * NSEC_PER_SEC,
+				     link_stats.tx_ns));
+	seq_printf(m, "rx_bytes: %llu\n", (unsigned long long)link_stats.rx_bytes);
+	if (link_stats.rx_ns)
+		seq_printf(m, "rx_bytes_per_sec: %llu\n",
+			   div64_u64(link_stats.rx_bytes * NSEC_PER_SEC,
+				     link_stats.rx_ns));
+	seq_printf(m, "rx_errors: %llu\n",
+		   (unsigned long long)link_stats.rx_errors);
+	mutex_unlock(&link_mutex);
+	return 0;
+}
+
+static void link_stats_reset(void)
+{
+	mutex_lock(&link_mutex);
+	memset(&link_stats, 0, sizeof(link_stats));
+	mutex_unlock(&link_mutex);
+}
+
+DEBUGFS_STATS_FOPS(link_stats);
+
+static const struct file_operations rx_inject_fops = {
+	.owner		= THIS_MODULE,
+	.write		= rx_inject_write,
+	.llseek		= no_llseek,
+};
+
+static void init_debugfs(void)
+{
+	debugfs_dir = debugfs_create_dir(LIRC_DRIVER_NAME, NULL);
+	if (IS_ERR_OR_NULL(debugfs_dir))
+		return;
+	debugfs_create_file("tx_frames", S_IRUSR, debugfs_dir, NULL,
+			    &txlog_frames_fops);
+	debugfs_create_file("tx_edges", S_IRUSR, debugfs_dir, NULL,
+			    &txlog_edges_fops);
+	debugfs_create_file("tx_stats", S_IRUSR | S_IWUSR, debugfs_dir, NULL,
+			    &txstats_fops);
+	debugfs_create_file("rx_inject", S_IWUSR, debugfs_dir, NULL,
+			    &rx_inject_fops);
+	debugfs_create_file("rx_inject_stats", S_IRUSR | S_IWUSR, debugfs_dir,
+			    NULL, &rx_inject_stats_fops);
+	debugfs_create_u32("rx_inject_jitter_us", S_IRUSR | S_IWUSR,
+			   debugfs_dir, &rx_inject_jitter_us);
+	debugfs_create_u32("rx_inject_glitch_permille", S_IRUSR | S_IWUSR,
+			   debugfs_dir, &rx_inject_glitch_permille);
+	debugfs_create_u32("rx_inject_glitch_us", S_IRUSR | S_IWUSR,
+			   debugfs_dir, &rx_inject_glitch_us);
+	debugfs_create_u32("rx_inject_drop_permille", S_IRUSR | S_IWUSR,
+			   debugfs_dir, &rx_inject_drop_permille);
+	debugfs_create_file("link_stats", S_IRUSR | S_IWUSR, debugfs_dir, NULL,
+			    &link_stats_fops);
+	debugfs_create_atomic_t("lbt_collisions", S_IRUSR, debugfs_dir,
+				&lbt_collisions);
+	debugfs_create_atomic_t("lbt_aborts", S_IRUSR, debugfs_dir,
+				&lbt_aborts);
+	debugfs_create_u64("rx_reads", S_IRUSR, debugfs_dir, &rx_reads);
+	debugfs_create_file("rx_latency", S_IRUSR | S_IWUSR, debugfs_dir, NULL,
+			    &rxlat_fops);
+	debugfs_create_u64("rx_xcpu_wakeups", S_IRUSR, debugfs_dir,
+			   &rx_xcpu_wakeups);
+	debugfs_create_u32("rx_edges_lost", S_IRUSR, debugfs_dir,
+			   &rx_hw_edges_lost);
+}
+
 static const struct of_device_id lirc_tegra_of_match[] = {
 	{ .compatible = "tegra,lirc-tegra", },
 	{},
@@ -639,18 +2031,31 @@ static struct platform_driver lirc_tegra_driver = {
 static int __init lirc_tegra_init(void)
 {
 	struct device_node *node;
-	int result;
+	int result, i;
 
 	/* Init read buffer. */
 	result = lirc_buffer_init(&rbuf, sizeof(int), RBUF_LEN);
 	if (result < 0)
 		return -ENOMEM;
+	INIT_KFIFO(rx_stamps);
+	INIT_KFIFO(rx_hw_edges);
+	sema_init(&tx_slots, ARRAY_SIZE(tx_tables));
+
+	/* full size up front, so write() never allocates */
+	for (i = 0; i < ARRAY_SIZE(tx_tables); i++) {
+		tx_tables[i].steps = vmalloc(TX_MAX_STEPS *
+					     sizeof(struct tx_step));
+		if (!tx_tables[i].steps) {
+			result = -ENOMEM;
+			goto exit_tables_free;
+		}
+	}
 
 	result = platform_driver_register(&lirc_tegra_driver);
 	if (result) {
 		printk(KERN_ERR LIRC_DRIVER_NAME
 		       ": lirc register returned %d\n", result);
-		goto exit_buffer_free;
+		goto exit_tables_free;
 	}
 
 	node = of_find_compatible_node(NULL, NULL,
@@ -682,7 +2087,9 @@ static int __init lirc_tegra_init(void)
 	exit_driver_unregister:
 	platform_driver_unregister(&lirc_tegra_driver);
 
-	exit_buffer_free:
+	exit_tables_free:
+	for (i = 0; i < ARRAY_SIZE(tx_tables); i++)
+		vfree(tx_tables[i].steps);
 	lirc_buffer_free(&rbuf);
 
 	return result;
@@ -690,6 +2097,10 @@ static int __init lirc_tegra_init(void)
 
 static void lirc_tegra_exit(void)
 {
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tx_tables); i++)
+		vfree(tx_tables[i].steps);
 	if (!lirc_tegra_dev->dev.of_node)
 		platform_device_unregister(lirc_tegra_dev);
 	platform_driver_unregister(&lirc_tegra_driver);
@@ -733,6 +2144,8 @@ static int __init lirc_tegra_init_module(void)
 
 	printk(KERN_INFO LIRC_DRIVER_NAME ": driver registered!\n");
 
+	init_debugfs();
+
 	dprintk("driver.features = %d\n", driver.features);
 	dprintk("softcarrier = %d\n", softcarrier);
 	dprintk("gpio_in_pin = %d\n", gpio_in_pin);
@@ -750,6 +2163,7 @@ static int __init lirc_tegra_init_module(void)
 static void __exit lirc_tegra_exit_module(void)
 {
 	int i;
+	debugfs_remove_recursive(debugfs_dir);
 	lirc_unregister_driver(driver.minor);
 
 	for (i = 0; i < n_transmitters; i++)
@@ -800,5 +2214,142 @@ MODULE_PARM_DESC(invert, "Invert output (0 = off, 1 = on, default off");
 module_param(debug, bool, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(debug, "Enable debugging messages");
 
+static int txlog_set(const char *val, const struct kernel_param *kp)
+{
+	int result = param_set_bool(val, kp);
+
+	if (result)
+		return result;
+	if (txlog)
+		static_branch_enable(&txlog_key);
+	else
+		static_branch_disable(&txlog_key);
+	return 0;
+}
+
+static const struct kernel_param_ops txlog_ops = {
+	.set	= txlog_set,
+	.get	= param_get_bool,
+};
+
+module_param_cb(txlog, &txlog_ops, &txlog, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(txlog, "Log actual vs target TX edges to debugfs"
+		 " (0 = off, 1 = on, default off)");
+
+module_param(lbt_window_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lbt_window_us, "Listen before talk: only transmit once the"
+		 " receiver has been quiet this long (0 = off, default 0)");
+
+module_param(lbt_retries, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lbt_retries, "Listen before talk: retries before failing"
+		 " with EBUSY (default 5)");
+
+module_param(lbt_backoff_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lbt_backoff_us, "Listen before talk: maximum random"
+		 " backoff added to the window between retries (default 20000)");
+
+module_param(lbt_echo_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lbt_echo_us, "Listen before talk: edges up to this long"
+		 " after our own frame are its echo (default 1000)");
+
+module_param(link_unit_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(link_unit_us, "Data link: signalling unit in microseconds,"
+		 " same on both ends (min 100, default 100)");
+
+static int irq_cpu_set(const char *val, const struct kernel_param *kp)
+{
+	int cpu, result;
+
+	result = kstrtoint(val, 0, &cpu);
+	if (result)
+		return result;
+	if (cpu < -1 || cpu >= nr_cpu_ids || (cpu >= 0 && !cpu_online(cpu)))
+		return -EINVAL;
+	mutex_lock(&irq_cfg_mutex);
+	irq_cpu = cpu;
+	apply_irq_affinity();
+	mutex_unlock(&irq_cfg_mutex);
+	return 0;
+}
+
+static const struct kernel_param_ops irq_cpu_ops = {
+	.set	= irq_cpu_set,
+	.get	= param_get_int,
+};
+
+module_param_cb(irq_cpu, &irq_cpu_ops, &irq_cpu, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_cpu, "CPU to handle the receiver IRQ on"
+		 " (-1 = no preference, default -1)");
+
+static int irq_thread_policy_set(const char *val,
+				 const struct kernel_param *kp)
+{
+	int policy, result;
+
+	result = kstrtoint(val, 0, &policy);
+	if (result)
+		return result;
+	if (policy != -1 && policy != SCHED_NORMAL &&
+	    policy != SCHED_FIFO && policy != SCHED_RR)
+		return -EINVAL;
+
+	mutex_lock(&irq_cfg_mutex);
+	/* fifo and rr need a real-time priority to go with them */
+	if ((policy == SCHED_FIFO || policy == SCHED_RR) &&
+	    irq_thread_prio < 1) {
+		mutex_unlock(&irq_cfg_mutex);
+		return -EINVAL;
+	}
+	irq_thread_policy = policy;
+	atomic_inc(&irq_sched_gen);
+	mutex_unlock(&irq_cfg_mutex);
+	return 0;
+}
+
+static const struct kernel_param_ops irq_thread_policy_ops = {
+	.set	= irq_thread_policy_set,
+	.get	= param_get_int,
+};
+
+module_param_cb(irq_thread_policy, &irq_thread_policy_ops,
+		&irq_thread_policy, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_thread_policy, "Scheduling policy of the receiver"
+		 " IRQ thread that decodes edges and wakes readers"
+		 " (-1 = kernel default, 0 = normal, 1 = fifo, 2 = rr,"
+		 " default -1)");
+
+static int irq_thread_prio_set(const char *val,
+			       const struct kernel_param *kp)
+{
+	int prio, result;
+
+	result = kstrtoint(val, 0, &prio);
+	if (result)
+		return result;
+	if (prio < 0 || prio >= MAX_USER_RT_PRIO)
+		return -EINVAL;
+
+	mutex_lock(&irq_cfg_mutex);
+	if ((irq_thread_policy == SCHED_FIFO ||
+	     irq_thread_policy == SCHED_RR) && prio < 1) {
+		mutex_unlock(&irq_cfg_mutex);
+		return -EINVAL;
+	}
+	irq_thread_prio = prio;
+	atomic_inc(&irq_sched_gen);
+	mutex_unlock(&irq_cfg_mutex);
+	return 0;
+}
+
+static const struct kernel_param_ops irq_thread_prio_ops = {
+	.set	= irq_thread_prio_set,
+	.get	= param_get_int,
+};
+
+module_param_cb(irq_thread_prio, &irq_thread_prio_ops, &irq_thread_prio,
+		S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_thread_prio, "Real-time priority of the receiver"
+		 " IRQ thread for fifo/rr (1-99, default 50)");
+
 // tx_mask is deliberately not made available as module parameter;
 // it is a user parameter, not a hardware configuration parameter.
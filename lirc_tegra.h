@@ -0,0 +1,95 @@
+/*
+ * lirc_tegra.h
+ *
+ * Userspace interface of lirc_tegra beyond the standard lirc ioctls.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef _LIRC_TEGRA_H
+#define _LIRC_TEGRA_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* largest response a transaction can capture, in samples */
+#define LIRC_TEGRA_TRANSACT_MAX 4096
+/* longest timeout_us a transaction or LINK_RECV accepts, 5 s */
+#define LIRC_TEGRA_TIMEOUT_MAX_US 5000000
+
+/*
+ * Send a frame, then capture what the receiver sees for up to timeout_us
+ * after the end of the frame. Samples are in the same int format as
+ * write() and read(). Capture stops early once rx_max samples are in.
+ * From the moment the frame goes out until the transaction returns,
+ * received samples do not reach read(). A timeout_us above
+ * LIRC_TEGRA_TIMEOUT_MAX_US fails with EINVAL. A signal while waiting for the response fails with EINTR rather than
+ * restarting, as the frame has already been sent.
+ */
+struct lirc_tegra_transact {
+	__u64 tx_buf;		/* frame to send, odd number of samples */
+	__u64 rx_buf;		/* receives the response */
+	__u64 match_buf;	/* template to compare against, 0 = none */
+	__u64 response_ns;	/* out: end of frame to first response edge */
+	__u32 tx_count;
+	__u32 rx_max;
+	__u32 rx_count;		/* out */
+	__u32 match_count;
+	__u32 match_tolerance;	/* percent */
+	__s32 match_result;	/* out: 1 = match, 0 = no match, -1 = none */
+	__u32 holdoff_us;	/* ignore edges this long after the frame */
+	__u32 timeout_us;
+};
+
+/*
+ * Largest payload of one data link frame, in bytes. A frame is sent with
+ * interrupts off like any other, for up to 24 * (len + 4) + 7 units: 87
+ * ms for 32 bytes at the default 100 us unit. Send longer data as
+ * several frames; interrupts are back on between them.
+ */
+#define LIRC_TEGRA_LINK_MAX 32
+
+/* fragment number and last fragment flag of a data link frame */
+#define LIRC_TEGRA_LINK_SEQ 0x7f
+#define LIRC_TEGRA_LINK_LAST 0x80
+
+/*
+ * Data link over a wired connection, always without carrier. A frame is
+ * a 4 unit mark and 2 unit space, then the length byte, the fragment
+ * byte, the payload and a big-endian CRC-16 (crc_ccitt() of length,
+ * fragment byte and payload, seeded with 0xffff), each bit msb first as
+ * a 1 unit mark followed by a 1 unit (0) or 2 unit (1) space, then a
+ * closing 1 unit mark. The unit is set by the link_unit_us module
+ * parameter.
+ *
+ * LINK_SEND sends len bytes from buf. LINK_RECV waits up to timeout_us,
+ * at most LIRC_TEGRA_TIMEOUT_MAX_US, for a frame and stores its payload
+ * in buf, len being the capacity on entry and the payload length on
+ * return. A corrupt frame fails with EBADMSG, no frame with ETIMEDOUT. A
+ * frame longer than len fails with EMSGSIZE as soon as its length byte
+ * is in, before the rest is decoded, with len set to the payload length
+ * it needed; the frame is dropped.
+ *
+ * frag is sent and received as the fragment byte. Data longer than
+ * LIRC_TEGRA_LINK_MAX goes out as frames numbered 0, 1, 2... (modulo
+ * 128) in LIRC_TEGRA_LINK_SEQ, with LIRC_TEGRA_LINK_LAST set on the last
+ * one; a single frame is just LIRC_TEGRA_LINK_LAST. The CRC covers the
+ * fragment byte, so a receiver that gets a number other than the one it
+ * expects has lost a frame and must drop what it has collected.
+ */
+struct lirc_tegra_link {
+	__u64 buf;
+	__u32 len;
+	__u32 timeout_us;	/* LINK_RECV only */
+	__u32 frag;		/* in for LINK_SEND, out for LINK_RECV */
+	__u32 pad;
+};
+
+#define LIRC_TEGRA_TRANSACT	_IOWR('i', 0x80, struct lirc_tegra_transact)
+#define LIRC_TEGRA_LINK_SEND	_IOW('i', 0x81, struct lirc_tegra_link)
+#define LIRC_TEGRA_LINK_RECV	_IOWR('i', 0x82, struct lirc_tegra_link)
+
+#endif
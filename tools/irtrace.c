@@ -0,0 +1,323 @@
+/*
+ * irtrace.c
+ *
+ * Reading and writing of the compact indexed IR capture format.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/lirc.h>
+
+#include "irtrace.h"
+
+static const char header_magic[4] = { 'I', 'R', 'T', 'R' };
+static const char trailer_magic[4] = { 'I', 'R', 'T', 'X' };
+
+#define HEADER_LEN 8
+#define TRAILER_LEN 16
+
+static void put_le(unsigned char *p, uint64_t v, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		p[i] = v >> (8 * i);
+}
+
+static uint64_t get_le(const unsigned char *p, int len)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = len - 1; i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static int put_varint(FILE *fp, uint64_t v)
+{
+	while (v >= 0x80) {
+		if (putc((v & 0x7f) | 0x80, fp) == EOF)
+			return -1;
+		v >>= 7;
+	}
+	return putc(v, fp) == EOF ? -1 : 0;
+}
+
+/* returns 0, 1 on a clean end of file, -1 on a truncated or bad varint */
+static int get_varint(FILE *fp, uint64_t *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	for (;;) {
+		c = getc(fp);
+		if (c == EOF)
+			return shift ? -1 : 1;
+		if (shift > 63)
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+		shift += 7;
+	}
+}
+
+static int index_add(struct irt_file *f, uint64_t offset, uint64_t ts_ns)
+{
+	struct irt_index *index;
+
+	if (f->nframes == f->cap) {
+		f->cap = f->cap ? 2 * f->cap : 1024;
+		index = realloc(f->index, f->cap * sizeof(*index));
+		if (!index)
+			return -1;
+		f->index = index;
+	}
+	f->index[f->nframes].offset = offset;
+	f->index[f->nframes].ts_ns = ts_ns;
+	f->nframes++;
+	return 0;
+}
+
+int irt_create(struct irt_file *f, const char *path)
+{
+	unsigned char header[HEADER_LEN] = { 0 };
+
+	memset(f, 0, sizeof(*f));
+	f->fp = fopen(path, "wb");
+	if (!f->fp)
+		return -1;
+	memcpy(header, header_magic, sizeof(header_magic));
+	header[4] = IRT_VERSION;
+	if (fwrite(header, sizeof(header), 1, f->fp) != 1) {
+		fclose(f->fp);
+		return -1;
+	}
+	return 0;
+}
+
+int irt_append(struct irt_file *f, uint64_t ts_ns,
+	       const int *samples, unsigned int count)
+{
+	unsigned int i;
+	uint64_t v;
+	off_t offset;
+
+	if (ts_ns < f->last_ts)
+		ts_ns = f->last_ts;
+	offset = ftello(f->fp);
+	if (offset < 0 || index_add(f, offset, ts_ns) ||
+	    put_varint(f->fp, ts_ns - f->last_ts) ||
+	    put_varint(f->fp, count))
+		return -1;
+	for (i = 0; i < count; i++) {
+		v = (uint64_t)(samples[i] & PULSE_MASK) << 1;
+		if (samples[i] & PULSE_BIT)
+			v |= 1;
+		if (put_varint(f->fp, v))
+			return -1;
+	}
+	f->last_ts = ts_ns;
+	return 0;
+}
+
+int irt_finish(struct irt_file *f)
+{
+	unsigned char buf[TRAILER_LEN];
+	off_t index_offset;
+	uint32_t i;
+	int result = 0;
+
+	index_offset = ftello(f->fp);
+	if (index_offset < 0)
+		result = -1;
+	for (i = 0; i < f->nframes && !result; i++) {
+		put_le(buf, f->index[i].offset, 8);
+		put_le(buf + 8, f->index[i].ts_ns, 8);
+		if (fwrite(buf, 16, 1, f->fp) != 1)
+			result = -1;
+	}
+	put_le(buf, index_offset, 8);
+	put_le(buf + 8, f->nframes, 4);
+	memcpy(buf + 12, trailer_magic, sizeof(trailer_magic));
+	if (!result && fwrite(buf, sizeof(buf), 1, f->fp) != 1)
+		result = -1;
+	if (fclose(f->fp))
+		result = -1;
+	free(f->index);
+	f->fp = NULL;
+	f->index = NULL;
+	return result;
+}
+
+/* skip over a frame body, returning the sample count */
+static int skip_frame(FILE *fp, uint64_t *count)
+{
+	uint64_t i, v;
+
+	if (get_varint(fp, count))
+		return -1;
+	for (i = 0; i < *count; i++)
+		if (get_varint(fp, &v))
+			return -1;
+	return 0;
+}
+
+/* index the frames between the header and end, an offset into the file */
+static int rebuild_index(struct irt_file *f, off_t end)
+{
+	uint64_t delta, count, ts = 0;
+	off_t offset;
+	int result;
+
+	if (fseeko(f->fp, HEADER_LEN, SEEK_SET))
+		return -1;
+	for (;;) {
+		offset = ftello(f->fp);
+		if (offset < 0)
+			return -1;
+		if (offset >= end)
+			break;
+		result = get_varint(f->fp, &delta);
+		if (result)
+			break;
+		if (skip_frame(f->fp, &count) || ftello(f->fp) > end)
+			break;
+		ts += delta;
+		if (index_add(f, offset, ts))
+			return -1;
+	}
+	/* a partly written last frame is dropped */
+	return 0;
+}
+
+int irt_open(struct irt_file *f, const char *path)
+{
+	unsigned char buf[TRAILER_LEN];
+	off_t size, end;
+
+	memset(f, 0, sizeof(*f));
+	f->fp = fopen(path, "rb");
+	if (!f->fp)
+		return -1;
+	if (fread(buf, HEADER_LEN, 1, f->fp) != 1 ||
+	    memcmp(buf, header_magic, sizeof(header_magic)) ||
+	    buf[4] != IRT_VERSION) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if (fseeko(f->fp, 0, SEEK_END))
+		goto fail;
+	size = ftello(f->fp);
+	if (size < 0)
+		goto fail;
+	if (size >= HEADER_LEN + TRAILER_LEN &&
+	    !fseeko(f->fp, size - TRAILER_LEN, SEEK_SET) &&
+	    fread(buf, TRAILER_LEN, 1, f->fp) == 1 &&
+	    !memcmp(buf + 12, trailer_magic, sizeof(trailer_magic))) {
+		f->index_offset = get_le(buf, 8);
+		f->nframes = get_le(buf + 8, 4);
+		if (f->index_offset + 16 * (uint64_t)f->nframes ==
+		    (uint64_t)size - TRAILER_LEN)
+			return 0;
+		/* a bad index, but the frames still end where it starts */
+		if (f->index_offset < HEADER_LEN ||
+		    f->index_offset > (uint64_t)size - TRAILER_LEN) {
+			errno = EINVAL;
+			goto fail;
+		}
+		f->nframes = 0;
+		end = f->index_offset;
+	} else {
+		/* no trailer, recording stopped before the index was written */
+		end = size;
+	}
+	if (!rebuild_index(f, end))
+		return 0;
+fail:
+	irt_close(f);
+	return -1;
+}
+
+static int index_get(struct irt_file *f, uint32_t frame, struct irt_index *e)
+{
+	unsigned char buf[16];
+
+	if (frame >= f->nframes) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (f->index) {
+		*e = f->index[frame];
+		return 0;
+	}
+	if (fseeko(f->fp, f->index_offset + 16 * (uint64_t)frame, SEEK_SET) ||
+	    fread(buf, sizeof(buf), 1, f->fp) != 1)
+		return -1;
+	e->offset = get_le(buf, 8);
+	e->ts_ns = get_le(buf + 8, 8);
+	return 0;
+}
+
+int irt_frame_ts(struct irt_file *f, uint32_t frame, uint64_t *ts_ns)
+{
+	struct irt_index e;
+
+	if (index_get(f, frame, &e))
+		return -1;
+	*ts_ns = e.ts_ns;
+	return 0;
+}
+
+int irt_read_frame(struct irt_file *f, uint32_t frame, uint64_t *ts_ns,
+		   int **samples, unsigned int *count)
+{
+	struct irt_index e;
+	uint64_t delta, n, i, v;
+	int *buf;
+
+	errno = 0;
+	if (index_get(f, frame, &e) ||
+	    fseeko(f->fp, e.offset, SEEK_SET) ||
+	    get_varint(f->fp, &delta) || get_varint(f->fp, &n) ||
+	    n > IRT_MAX_SAMPLES)
+		goto bad;
+	buf = malloc((n ? n : 1) * sizeof(int));
+	if (!buf)
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (get_varint(f->fp, &v)) {
+			free(buf);
+			goto bad;
+		}
+		buf[i] = (v >> 1) & PULSE_MASK;
+		if (v & 1)
+			buf[i] |= PULSE_BIT;
+	}
+	*ts_ns = e.ts_ns;
+	*samples = buf;
+	*count = n;
+	return 0;
+bad:
+	if (!errno)
+		errno = EINVAL;
+	return -1;
+}
+
+void irt_close(struct irt_file *f)
+{
+	if (f->fp)
+		fclose(f->fp);
+	free(f->index);
+	memset(f, 0, sizeof(*f));
+}
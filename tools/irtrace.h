@@ -0,0 +1,61 @@
+/*
+ * irtrace.h
+ *
+ * Compact indexed file format for captured IR frames.
+ *
+ * A file is an 8 byte header ("IRTR", version, 3 zero bytes), the frames,
+ * an index and a 16 byte trailer. Each frame is a varint timestamp delta
+ * in ns from the previous frame, a varint sample count and one varint per
+ * sample holding (duration in us << 1 | pulse). Frames start and end with
+ * a pulse, so they can be written to a lirc device as they are; the gaps
+ * between frames are kept only as timestamps. The index holds a 64 bit
+ * offset and timestamp per frame, and the trailer the index offset, the
+ * frame count and "IRTX". All fixed width fields are little endian.
+ *
+ * A file whose trailer is missing, for example because recording was
+ * killed, is still readable: the index is rebuilt by scanning the frames.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef IRTRACE_H
+#define IRTRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define IRT_VERSION 1
+/* sanity limit on the samples in one frame */
+#define IRT_MAX_SAMPLES (1 << 20)
+
+struct irt_index {
+	uint64_t offset;
+	uint64_t ts_ns;
+};
+
+struct irt_file {
+	FILE *fp;
+	uint64_t last_ts;
+	/* writing: every frame so far; reading: only when rebuilt by a scan */
+	struct irt_index *index;
+	uint32_t nframes;
+	uint32_t cap;
+	uint64_t index_offset;
+};
+
+int irt_create(struct irt_file *f, const char *path);
+int irt_append(struct irt_file *f, uint64_t ts_ns,
+	       const int *samples, unsigned int count);
+int irt_finish(struct irt_file *f);
+
+int irt_open(struct irt_file *f, const char *path);
+int irt_frame_ts(struct irt_file *f, uint32_t frame, uint64_t *ts_ns);
+/* *samples is malloc()ed and must be freed by the caller */
+int irt_read_frame(struct irt_file *f, uint32_t frame, uint64_t *ts_ns,
+		   int **samples, unsigned int *count);
+void irt_close(struct irt_file *f);
+
+#endif
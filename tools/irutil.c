@@ -0,0 +1,405 @@
+/*
+ * irutil.c
+ *
+ * Helpers shared by the lirc_tegra test tools.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/lirc.h>
+
+#include "irtrace.h"
+#include "irutil.h"
+
+/* how long to wait for the tail of an injected frame, in ms */
+#define INJECT_TIMEOUT_MS 20
+
+static struct ir_frame *suite_add(struct ir_suite *s, const char *path)
+{
+	struct ir_frame *frames, *f;
+	const char *base = strrchr(path, '/');
+
+	if (s->count == s->cap) {
+		s->cap = s->cap ? 2 * s->cap : 16;
+		frames = realloc(s->frames, s->cap * sizeof(*frames));
+		if (!frames)
+			return NULL;
+		s->frames = frames;
+	}
+	f = &s->frames[s->count];
+	memset(f, 0, sizeof(*f));
+	f->file = s->files;
+	snprintf(f->name, sizeof(f->name), "%s", base ? base + 1 : path);
+	return f;
+}
+
+static int load_irt(struct ir_suite *s, const char *path)
+{
+	struct irt_file in;
+	struct ir_frame *f;
+	uint64_t ts;
+	uint32_t i;
+	size_t len;
+
+	if (irt_open(&in, path))
+		return -1;
+	for (i = 0; i < in.nframes; i++) {
+		f = suite_add(s, path);
+		if (!f || irt_read_frame(&in, i, &ts, &f->samples, &f->count)) {
+			irt_close(&in);
+			return -1;
+		}
+		if (!f->count) {
+			free(f->samples);
+			continue;
+		}
+		len = strlen(f->name);
+		snprintf(f->name + len, sizeof(f->name) - len, ":%u", i);
+		s->count++;
+	}
+	irt_close(&in);
+	return 0;
+}
+
+int ir_split_add(struct ir_splitter *sp, int sample)
+{
+	int *frame;
+
+	if (!(sample & PULSE_BIT)) {
+		if (!sp->len)
+			return 0;
+		if ((unsigned int)(sample & PULSE_MASK) >= sp->gap_us)
+			return ir_split_flush(sp);
+	}
+	if (sp->len == sp->cap) {
+		sp->cap = sp->cap ? 2 * sp->cap : 256;
+		frame = realloc(sp->frame, sp->cap * sizeof(int));
+		if (!frame)
+			return -1;
+		sp->frame = frame;
+	}
+	sp->frame[sp->len++] = sample;
+	return 0;
+}
+
+int ir_split_flush(struct ir_splitter *sp)
+{
+	unsigned int len = sp->len;
+
+	/* frames end on a pulse, a trailing space is part of the gap */
+	if (len && !(sp->frame[len - 1] & PULSE_BIT))
+		len--;
+	sp->len = 0;
+	return len ? sp->emit(sp->ctx, sp->frame, len) : 0;
+}
+
+void ir_split_free(struct ir_splitter *sp)
+{
+	free(sp->frame);
+	sp->frame = NULL;
+	sp->len = sp->cap = 0;
+}
+
+int ir_mode2_sample(const char *line, int *sample)
+{
+	char kind[16];
+	unsigned int us;
+
+	if (sscanf(line, "%15s %u", kind, &us) != 2)
+		return 0;
+	if (us > PULSE_MASK)
+		us = PULSE_MASK;
+	if (!strcmp(kind, "pulse"))
+		*sample = us | PULSE_BIT;
+	else if (!strcmp(kind, "space"))
+		*sample = us;
+	else
+		return 0;
+	return 1;
+}
+
+struct text_ctx {
+	struct ir_suite *s;
+	const char *path;
+	unsigned int n;
+};
+
+static int text_frame(void *ctx, const int *frame, unsigned int count)
+{
+	struct text_ctx *t = ctx;
+	struct ir_frame *f;
+	size_t len;
+
+	f = suite_add(t->s, t->path);
+	if (!f)
+		return -1;
+	f->samples = malloc(count * sizeof(int));
+	if (!f->samples)
+		return -1;
+	memcpy(f->samples, frame, count * sizeof(int));
+	f->count = count;
+	len = strlen(f->name);
+	snprintf(f->name + len, sizeof(f->name) - len, ":%u", t->n++);
+	t->s->count++;
+	return 0;
+}
+
+/* mode2 text, frames split at spaces of at least IR_FRAME_GAP_US */
+static int load_text(struct ir_suite *s, FILE *in, const char *path)
+{
+	struct text_ctx t = { .s = s, .path = path };
+	struct ir_splitter sp = {
+		.gap_us = IR_FRAME_GAP_US,
+		.emit = text_frame,
+		.ctx = &t,
+	};
+	char line[128];
+	int sample, result = 0;
+
+	while (!result && fgets(line, sizeof(line), in))
+		if (ir_mode2_sample(line, &sample))
+			result = ir_split_add(&sp, sample);
+	if (!result)
+		result = ir_split_flush(&sp);
+	ir_split_free(&sp);
+	return result || ferror(in) ? -1 : 0;
+}
+
+int ir_suite_load(struct ir_suite *s, const char *path)
+{
+	char magic[4];
+	unsigned int i;
+	FILE *in;
+	int result;
+
+	in = fopen(path, "rb");
+	if (!in)
+		return -1;
+	if (fread(magic, sizeof(magic), 1, in) == 1 &&
+	    !memcmp(magic, "IRTR", sizeof(magic))) {
+		result = load_irt(s, path);
+	} else {
+		rewind(in);
+		result = load_text(s, in, path);
+	}
+	fclose(in);
+	s->files++;
+	for (i = 0; i < s->count; i++)
+		if (s->frames[i].count > s->max_count)
+			s->max_count = s->frames[i].count;
+	return result;
+}
+
+void ir_suite_free(struct ir_suite *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->count; i++)
+		free(s->frames[i].samples);
+	free(s->frames);
+	memset(s, 0, sizeof(*s));
+}
+
+int ir_write_all(int fd, const int *buf, unsigned int count)
+{
+	ssize_t n = write(fd, buf, count * sizeof(int));
+
+	if (n < 0)
+		return -1;
+	if (n != (ssize_t)(count * sizeof(int))) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+void ir_drain(int fd)
+{
+	int buf[256];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+int ir_read_frame(int fd, int *buf, unsigned int have, unsigned int want,
+		  int timeout_ms)
+{
+	struct pollfd p = { .fd = fd, .events = POLLIN };
+	int tmp[256];
+	unsigned int n;
+	ssize_t len;
+	int i, r;
+
+	while (have < want) {
+		r = poll(&p, 1, timeout_ms);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return -1;
+		if (r == 0)
+			break;
+		n = want - have;
+		if (n > sizeof(tmp) / sizeof(int))
+			n = sizeof(tmp) / sizeof(int);
+		len = read(fd, tmp, n * sizeof(int));
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if (len < 0)
+			return -1;
+		if (len == 0)
+			break;
+		for (i = 0; i < len / (ssize_t)sizeof(int); i++)
+			if (have || (tmp[i] & PULSE_BIT))
+				buf[have++] = tmp[i];
+	}
+	return have;
+}
+
+int ir_inject_frame(int inject_fd, int lirc_fd, unsigned int gap_us,
+		    const int *frame, unsigned int count, int *out)
+{
+	int gap = gap_us < PULSE_MASK ? gap_us : PULSE_MASK;
+	unsigned int i, n;
+	int have = 0;
+
+	/* glitches can add samples, so read back up to twice as many */
+	if (ir_write_all(inject_fd, &gap, 1))
+		return -1;
+	for (i = 0; i < count; i += n) {
+		n = count - i < IR_INJECT_CHUNK ? count - i : IR_INJECT_CHUNK;
+		if (ir_write_all(inject_fd, frame + i, n))
+			return -1;
+		have = ir_read_frame(lirc_fd, out, have, 2 * count, 0);
+		if (have < 0)
+			return -1;
+	}
+	return ir_read_frame(lirc_fd, out, have, 2 * count,
+			     INJECT_TIMEOUT_MS);
+}
+
+static int errs_reserve(struct ir_errs *e, size_t n)
+{
+	int *err;
+
+	if (e->count + n <= e->cap)
+		return 0;
+	e->cap = 2 * (e->count + n);
+	err = realloc(e->err_us, e->cap * sizeof(int));
+	if (!err)
+		return -1;
+	e->err_us = err;
+	return 0;
+}
+
+int ir_errs_compare(struct ir_errs *e, const int *want, unsigned int nwant,
+		    const int *got, unsigned int ngot)
+{
+	unsigned int i, n = nwant < ngot ? nwant : ngot;
+
+	e->frames++;
+	if (ngot < nwant)
+		e->short_frames++;
+	else if (ngot > nwant)
+		e->long_frames++;
+	if (errs_reserve(e, n))
+		return -1;
+	for (i = 0; i < n; i++) {
+		if ((want[i] ^ got[i]) & PULSE_BIT) {
+			e->level_errors++;
+			break;
+		}
+		e->err_us[e->count++] = (got[i] & PULSE_MASK) -
+			(want[i] & PULSE_MASK);
+	}
+	return 0;
+}
+
+int ir_errs_merge(struct ir_errs *to, const struct ir_errs *from)
+{
+	if (errs_reserve(to, from->count))
+		return -1;
+	memcpy(to->err_us + to->count, from->err_us,
+	       from->count * sizeof(int));
+	to->count += from->count;
+	to->frames += from->frames;
+	to->short_frames += from->short_frames;
+	to->long_frames += from->long_frames;
+	to->level_errors += from->level_errors;
+	return 0;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+void ir_errs_report(FILE *fp, const char *name, struct ir_errs *e)
+{
+	static const unsigned int permille[] = { 500, 900, 990, 999 };
+	long long sum = 0;
+	unsigned int i;
+	size_t k;
+	int *abs_us;
+
+	fprintf(fp, "%s: frames %llu samples %zu short %llu long %llu"
+		" level_errors %llu\n", name, (unsigned long long)e->frames,
+		e->count, (unsigned long long)e->short_frames,
+		(unsigned long long)e->long_frames,
+		(unsigned long long)e->level_errors);
+	if (!e->count)
+		return;
+	abs_us = malloc(e->count * sizeof(int));
+	if (!abs_us)
+		return;
+	for (k = 0; k < e->count; k++) {
+		sum += e->err_us[k];
+		abs_us[k] = abs(e->err_us[k]);
+	}
+	qsort(abs_us, e->count, sizeof(int), cmp_int);
+	fprintf(fp, "%s: mean_error_us %+.1f", name, (double)sum / e->count);
+	for (i = 0; i < sizeof(permille) / sizeof(permille[0]); i++) {
+		k = (e->count * permille[i] + 999) / 1000;
+		fprintf(fp, " p%u.%u %d", permille[i] / 10, permille[i] % 10,
+			abs_us[k ? k - 1 : 0]);
+	}
+	fprintf(fp, " max %d\n", abs_us[e->count - 1]);
+	free(abs_us);
+}
+
+void ir_errs_report_files(FILE *fp, const char *prefix,
+			  const struct ir_suite *s, struct ir_errs *errs,
+			  struct ir_errs *total)
+{
+	char name[64], *colon;
+	unsigned int f, i;
+
+	for (f = 0; f < s->files; f++) {
+		for (i = 0; i < s->count; i++)
+			if (s->frames[i].file == f)
+				break;
+		if (i == s->count)
+			continue;
+		snprintf(name, sizeof(name), "%s%s", prefix, s->frames[i].name);
+		colon = strrchr(name, ':');
+		if (colon)
+			*colon = '\0';
+		ir_errs_report(fp, name, &errs[f]);
+		ir_errs_merge(total, &errs[f]);
+	}
+}
+
+void ir_errs_free(struct ir_errs *e)
+{
+	free(e->err_us);
+	memset(e, 0, sizeof(*e));
+}
@@ -0,0 +1,110 @@
+/*
+ * irutil.h
+ *
+ * Helpers shared by the lirc_tegra test tools: loading frame suites,
+ * moving frames through a lirc device or the rx_inject debugfs file and
+ * collecting per-sample timing errors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef IRUTIL_H
+#define IRUTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/* a space this long ends a frame, same as the driver */
+#define IR_FRAME_GAP_US 20000
+/* samples per write to rx_inject, well below the 256 sample rbuf */
+#define IR_INJECT_CHUNK 128
+/* default space fed to the receive path in front of a frame, in us */
+#define IR_INJECT_GAP_US 100000
+
+struct ir_frame {
+	int *samples;		/* starts and ends with a pulse */
+	unsigned int count;
+	unsigned int file;	/* index of the file it came from */
+	char name[32];		/* file name and frame number */
+};
+
+struct ir_suite {
+	struct ir_frame *frames;
+	unsigned int count;
+	unsigned int cap;
+	unsigned int files;
+	unsigned int max_count;	/* samples in the longest frame */
+};
+
+/*
+ * Splits a stream of samples into frames at spaces of at least gap_us
+ * and hands each frame to emit(). Spaces before a frame are dropped and
+ * a trailing space is part of the gap, so frames start and end with a
+ * pulse. Set gap_us, emit and ctx, zero the rest.
+ */
+struct ir_splitter {
+	unsigned int gap_us;
+	int (*emit)(void *ctx, const int *frame, unsigned int count);
+	void *ctx;
+	int *frame;
+	unsigned int len;	/* samples of the frame so far */
+	unsigned int cap;
+};
+
+int ir_split_add(struct ir_splitter *sp, int sample);
+/* emit what is left at the end of the stream */
+int ir_split_flush(struct ir_splitter *sp);
+void ir_split_free(struct ir_splitter *sp);
+
+/* parse a "pulse N" or "space N" line of mode2 text, 0 if it is neither */
+int ir_mode2_sample(const char *line, int *sample);
+
+/* append the frames of a capture (.irt) or a mode2 text file */
+int ir_suite_load(struct ir_suite *s, const char *path);
+void ir_suite_free(struct ir_suite *s);
+
+int ir_write_all(int fd, const int *buf, unsigned int count);
+/* read and drop whatever is queued on a non-blocking lirc fd */
+void ir_drain(int fd);
+/*
+ * Read from a non-blocking lirc fd into buf[have..want), dropping spaces
+ * before the first pulse, until want samples are in or nothing arrives
+ * for timeout_ms. Returns the new sample count or -1 on error.
+ */
+int ir_read_frame(int fd, int *buf, unsigned int have, unsigned int want,
+		  int timeout_ms);
+/*
+ * Feed a frame, preceded by a gap_us space, to the receive path through
+ * rx_inject in IR_INJECT_CHUNK pieces, reading the result back from the
+ * lirc device after each piece so rbuf never overruns. out needs room
+ * for 2 * count samples. Returns the samples read back or -1 on error.
+ */
+int ir_inject_frame(int inject_fd, int lirc_fd, unsigned int gap_us,
+		    const int *frame, unsigned int count, int *out);
+
+/* signed per-sample errors in us between sent and received frames */
+struct ir_errs {
+	int *err_us;
+	size_t count;
+	size_t cap;
+	uint64_t frames;
+	uint64_t short_frames;	/* fewer samples came back than were sent */
+	uint64_t long_frames;	/* more samples came back than were sent */
+	uint64_t level_errors;	/* a pulse came back as a space or vice versa */
+};
+
+int ir_errs_compare(struct ir_errs *e, const int *want, unsigned int nwant,
+		    const int *got, unsigned int ngot);
+int ir_errs_merge(struct ir_errs *to, const struct ir_errs *from);
+void ir_errs_report(FILE *fp, const char *name, struct ir_errs *e);
+/* report errs[file] for every file of the suite, adding them to total */
+void ir_errs_report_files(FILE *fp, const char *prefix,
+			  const struct ir_suite *s, struct ir_errs *errs,
+			  struct ir_errs *total);
+void ir_errs_free(struct ir_errs *e);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * lirc_tegra_record.c
+ *
+ * Record frames from a lirc device (or a raw sample dump, or mode2 text)
+ * into the compact indexed format described in irtrace.h.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/lirc.h>
+
+#include "irtrace.h"
+#include "irutil.h"
+
+#define DEFAULT_DEVICE "/dev/lirc0"
+static volatile sig_atomic_t stop;
+
+struct recorder {
+	struct irt_file out;
+	struct ir_splitter split;
+	int live;		/* timestamps from the clock, not the samples */
+	uint64_t clock_ns;	/* running sum of durations when not live */
+	uint64_t frame_ts;
+	uint64_t frames;
+};
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_frame(void *ctx, const int *frame, unsigned int count)
+{
+	struct recorder *r = ctx;
+
+	if (irt_append(&r->out, r->frame_ts, frame, count))
+		return -1;
+	r->frames++;
+	return 0;
+}
+
+static int add_sample(struct recorder *r, int sample)
+{
+	unsigned int us = sample & PULSE_MASK;
+
+	/* a pulse is read when it ends */
+	if ((sample & PULSE_BIT) && !r->split.len)
+		r->frame_ts = r->live ? now_ns() - us * 1000ULL : r->clock_ns;
+	r->clock_ns += us * 1000ULL;
+	return ir_split_add(&r->split, sample);
+}
+
+static int record_raw(struct recorder *r, int fd)
+{
+	int buf[256];
+	ssize_t n;
+	int i;
+
+	while (!stop) {
+		n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("read");
+			return -1;
+		}
+		if (n == 0)
+			break;
+		for (i = 0; i < n / (ssize_t)sizeof(int); i++)
+			if (add_sample(r, buf[i]))
+				return -1;
+	}
+	return 0;
+}
+
+static int record_text(struct recorder *r, FILE *in)
+{
+	char line[128];
+	int sample;
+
+	while (!stop && fgets(line, sizeof(line), in))
+		if (ir_mode2_sample(line, &sample) && add_sample(r, sample))
+			return -1;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-t] [-g gap_us] output\n"
+		"  -d  lirc device or raw sample file, - for stdin"
+		" (default " DEFAULT_DEVICE ")\n"
+		"  -t  input is mode2 text (\"pulse N\" / \"space N\" lines)\n"
+		"  -g  space that ends a frame in us (default %d)\n",
+		prog, IR_FRAME_GAP_US);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	struct recorder r;
+	struct sigaction sa;
+	struct stat st;
+	int opt, fd, text = 0, result;
+	FILE *in;
+
+	memset(&r, 0, sizeof(r));
+	r.split.gap_us = IR_FRAME_GAP_US;
+	r.split.emit = write_frame;
+	r.split.ctx = &r;
+	while ((opt = getopt(argc, argv, "d:tg:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			text = 1;
+			break;
+		case 'g':
+			r.split.gap_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	fd = strcmp(device, "-") ? open(device, O_RDONLY) : 0;
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	r.live = !fstat(fd, &st) && S_ISCHR(st.st_mode);
+	if (irt_create(&r.out, argv[optind])) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	/* no SA_RESTART, so a blocked read() returns and the index is written */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (text) {
+		in = fdopen(fd, "r");
+		result = in ? record_text(&r, in) : -1;
+	} else {
+		result = record_raw(&r, fd);
+	}
+	if (!result)
+		result = ir_split_flush(&r.split);
+	if (irt_finish(&r.out))
+		result = -1;
+	if (result) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fprintf(stderr, "%llu frames\n", (unsigned long long)r.frames);
+	ir_split_free(&r.split);
+	return 0;
+}
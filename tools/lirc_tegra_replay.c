@@ -0,0 +1,239 @@
+/*
+ * lirc_tegra_replay.c
+ *
+ * Replay frames recorded by lirc_tegra_record: transmit them through a
+ * lirc device with their original spacing, feed them to the lirc_tegra
+ * receive path through debugfs and print what comes back, or list and
+ * print them.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/lirc.h>
+
+#include "irtrace.h"
+#include "irutil.h"
+
+#define DEFAULT_DEVICE "/dev/lirc0"
+#define DEFAULT_INJECT "/sys/kernel/debug/lirc_tegra/rx_inject"
+enum mode { TRANSMIT, INJECT, LIST, PRINT };
+
+static uint64_t frame_length_ns(const int *samples, unsigned int count)
+{
+	uint64_t ns = 0;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		ns += (samples[i] & PULSE_MASK) * 1000ULL;
+	return ns;
+}
+
+static void print_frame(uint32_t frame, uint64_t ts, const int *samples,
+			unsigned int count)
+{
+	unsigned int i;
+
+	printf("# frame %u %llu\n", frame, (unsigned long long)ts);
+	for (i = 0; i < count; i++)
+		printf("%s %u\n", samples[i] & PULSE_BIT ? "pulse" : "space",
+		       samples[i] & PULSE_MASK);
+}
+
+/* sleep until offset_ns after start on the monotonic clock */
+static void wait_until(const struct timespec *start, uint64_t offset_ns)
+{
+	struct timespec t;
+
+	t.tv_sec = start->tv_sec + offset_ns / 1000000000ULL;
+	t.tv_nsec = start->tv_nsec + offset_ns % 1000000000ULL;
+	if (t.tv_nsec >= 1000000000L) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000L;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) ==
+	       EINTR)
+		;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-r [-i inject] | -l | -m] [-f first]"
+		" [-n count] input\n"
+		"  -d  lirc device to write to, with -r to read back from"
+		" (default " DEFAULT_DEVICE ")\n"
+		"  -r  feed the frames to the receive path instead of sending"
+		" them,\n"
+		"      print what comes back as mode2 text\n"
+		"  -i  rx_inject file for -r (default " DEFAULT_INJECT ")\n"
+		"  -l  list frames: number, timestamp in ns, samples, length in us\n"
+		"  -m  print frames as mode2 text\n"
+		"  -f  first frame (default 0)\n"
+		"  -n  number of frames (default all)\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE, *inject = DEFAULT_INJECT;
+	enum mode mode = TRANSMIT;
+	struct irt_file in;
+	struct ir_errs errs;
+	struct timespec start;
+	uint64_t ts, first_ts = 0, prev_end = 0, gap;
+	uint32_t first = 0, count = UINT32_MAX, frame, last;
+	unsigned int n;
+	int *samples, *out;
+	int opt, fd = -1, inject_fd = -1, got, result = 0;
+
+	while ((opt = getopt(argc, argv, "d:ri:lmf:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'r':
+			mode = INJECT;
+			break;
+		case 'i':
+			inject = optarg;
+			break;
+		case 'l':
+			mode = LIST;
+			break;
+		case 'm':
+			mode = PRINT;
+			break;
+		case 'f':
+			first = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (irt_open(&in, argv[optind])) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (first && first >= in.nframes) {
+		fprintf(stderr, "%s: frame %u is past the end (%u frames)\n",
+			argv[optind], first, in.nframes);
+		irt_close(&in);
+		return 1;
+	}
+	last = in.nframes;
+	if (count < last - first)
+		last = first + count;
+
+	if (mode == TRANSMIT) {
+		fd = open(device, O_WRONLY);
+		if (fd < 0) {
+			perror(device);
+			return 1;
+		}
+	} else if (mode == INJECT) {
+		/* read back as we go, or rbuf overruns */
+		fd = open(device, O_RDONLY | O_NONBLOCK);
+		if (fd < 0) {
+			perror(device);
+			return 1;
+		}
+		inject_fd = open(inject, O_WRONLY);
+		if (inject_fd < 0) {
+			perror(inject);
+			return 1;
+		}
+	}
+	memset(&errs, 0, sizeof(errs));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (frame = first; frame < last && !result; frame++) {
+		if (irt_read_frame(&in, frame, &ts, &samples, &n)) {
+			perror(argv[optind]);
+			result = 1;
+			break;
+		}
+		if (frame == first)
+			first_ts = ts;
+
+		switch (mode) {
+		case TRANSMIT:
+			/* lirc only sends frames that start and end on a pulse */
+			if (n % 2 == 0) {
+				fprintf(stderr, "%s: frame %u has %u samples,"
+					" not an odd number\n", argv[optind],
+					frame, n);
+				result = 1;
+				break;
+			}
+			wait_until(&start, ts - first_ts);
+			if (ir_write_all(fd, samples, n)) {
+				perror(device);
+				result = 1;
+			}
+			break;
+		case INJECT:
+			/* the receiver sees the gap as a space before the frame */
+			gap = frame == first ? IR_INJECT_GAP_US :
+				ts > prev_end ? (ts - prev_end) / 1000 : 0;
+			out = malloc((2 * n + 1) * sizeof(int));
+			if (!out) {
+				perror("malloc");
+				result = 1;
+				break;
+			}
+			ir_drain(fd);
+			got = ir_inject_frame(inject_fd, fd,
+					      gap > PULSE_MASK ? PULSE_MASK : gap,
+					      samples, n, out);
+			if (got < 0) {
+				perror(inject);
+				result = 1;
+			} else {
+				print_frame(frame, ts, out, got);
+				ir_errs_compare(&errs, samples, n, out, got);
+			}
+			free(out);
+			break;
+		case LIST:
+			printf("%u %llu %u %llu\n", frame,
+			       (unsigned long long)ts, n,
+			       (unsigned long long)frame_length_ns(samples, n)
+			       / 1000);
+			break;
+		case PRINT:
+			print_frame(frame, ts, samples, n);
+			break;
+		}
+		prev_end = ts + frame_length_ns(samples, n);
+		free(samples);
+	}
+
+	if (mode == INJECT) {
+		ir_errs_report(stderr, "received", &errs);
+		ir_errs_free(&errs);
+		close(inject_fd);
+	}
+	if (fd >= 0)
+		close(fd);
+	irt_close(&in);
+	return result;
+}
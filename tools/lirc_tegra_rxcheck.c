@@ -0,0 +1,137 @@
+/*
+ * lirc_tegra_rxcheck.c
+ *
+ * Feed a suite of frames to the lirc_tegra receive path through the
+ * rx_inject debugfs file, read what comes out of the lirc device and
+ * report the error of every sample. Exits with 1 when a frame comes
+ * back with the wrong number of samples or a pulse and space swapped.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "irutil.h"
+
+#define DEFAULT_DEVICE "/dev/lirc0"
+#define DEFAULT_INJECT "/sys/kernel/debug/lirc_tegra/rx_inject"
+#define INJECT_STATS "/sys/kernel/debug/lirc_tegra/rx_inject_stats"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-i inject] [-n repeats] frames...\n"
+		"  -d  lirc device to read from (default " DEFAULT_DEVICE ")\n"
+		"  -i  rx_inject file (default " DEFAULT_INJECT ")\n"
+		"  -n  times to feed each frame (default 1)\n"
+		"frames are mode2 text or lirc_tegra_record captures\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE, *inject = DEFAULT_INJECT;
+	unsigned int repeats = 1, r, i, f;
+	struct ir_suite suite;
+	struct ir_errs *errs, total;
+	struct ir_frame *fr;
+	char line[128];
+	int opt, fd, inject_fd, n, result, *out;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "d:i:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'i':
+			inject = optarg;
+			break;
+		case 'n':
+			repeats = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		usage(argv[0]);
+
+	memset(&suite, 0, sizeof(suite));
+	for (; optind < argc; optind++) {
+		if (ir_suite_load(&suite, argv[optind])) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	if (!suite.count) {
+		fprintf(stderr, "no frames\n");
+		return 1;
+	}
+
+	fd = open(device, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	inject_fd = open(inject, O_WRONLY);
+	if (inject_fd < 0) {
+		perror(inject);
+		return 1;
+	}
+	errs = calloc(suite.files, sizeof(*errs));
+	out = malloc(2 * suite.max_count * sizeof(int));
+	if (!errs || !out) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (r = 0; r < repeats; r++) {
+		for (i = 0; i < suite.count; i++) {
+			fr = &suite.frames[i];
+			ir_drain(fd);
+			n = ir_inject_frame(inject_fd, fd, IR_INJECT_GAP_US,
+					    fr->samples, fr->count, out);
+			if (n < 0) {
+				perror(inject);
+				return 1;
+			}
+			if (n != (int)fr->count)
+				fprintf(stderr, "%s: %u samples in, %d out\n",
+					fr->name, fr->count, n);
+			ir_errs_compare(&errs[fr->file], fr->samples,
+					fr->count, out, n);
+		}
+	}
+
+	memset(&total, 0, sizeof(total));
+	ir_errs_report_files(stdout, "", &suite, errs, &total);
+	ir_errs_report(stdout, "all", &total);
+
+	fp = fopen(INJECT_STATS, "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp))
+			printf("rx_inject_stats %s", line);
+		fclose(fp);
+	}
+
+	result = total.short_frames || total.long_frames ||
+		total.level_errors;
+	for (f = 0; f < suite.files; f++)
+		ir_errs_free(&errs[f]);
+	ir_errs_free(&total);
+	close(inject_fd);
+	close(fd);
+	free(errs);
+	free(out);
+	ir_suite_free(&suite);
+	return result;
+}
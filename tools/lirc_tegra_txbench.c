@@ -0,0 +1,408 @@
+/*
+ * lirc_tegra_txbench.c
+ *
+ * Transmit a suite of frames through lirc_tegra, idle and under load
+ * from stress-ng, and report the driver's tx_stats, the error of the
+ * frames as read back through gpio_in_pin and how late threads on every
+ * CPU wake up while the frames go out.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <linux/lirc.h>
+
+#include "irutil.h"
+
+#define DEFAULT_DEVICE "/dev/lirc0"
+#define TX_STATS "/sys/kernel/debug/lirc_tegra/tx_stats"
+#define TXLOG_PARAM "/sys/module/lirc_tegra/parameters/txlog"
+#define MAX_PASSES 16
+/* wake-up latency probes: period, histogram range and warm-up */
+#define PROBE_PERIOD_NS 1000000
+#define PROBE_BUCKETS 10001
+#define WARMUP_S 1
+
+struct probe {
+	pthread_t thread;
+	int cpu;
+	uint32_t *hist;		/* 1 us buckets, the last catching the rest */
+	uint64_t count;
+};
+
+static volatile int probes_stop;
+
+struct loopback {
+	pthread_t thread;
+	int fd;
+	int *buf;
+	unsigned int want;
+	int have;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec t = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (nanosleep(&t, &t) && errno == EINTR)
+		;
+}
+
+/* sleep a fixed period and record how late each wake-up is */
+static void *probe_run(void *arg)
+{
+	struct probe *p = arg;
+	struct sched_param sp = { .sched_priority = 98 };
+	struct timespec t;
+	cpu_set_t set;
+	uint64_t next, late;
+
+	CPU_ZERO(&set);
+	CPU_SET(p->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	/* without the privilege the probe still runs, just less precisely */
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+
+	next = now_ns();
+	while (!probes_stop) {
+		next += PROBE_PERIOD_NS;
+		t.tv_sec = next / 1000000000ULL;
+		t.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+		late = (now_ns() - next) / 1000;
+		p->hist[late < PROBE_BUCKETS - 1 ? late : PROBE_BUCKETS - 1]++;
+		p->count++;
+	}
+	return NULL;
+}
+
+static struct probe *probes_start(int ncpus)
+{
+	struct probe *p;
+	int i;
+
+	p = calloc(ncpus, sizeof(*p));
+	if (!p)
+		return NULL;
+	probes_stop = 0;
+	for (i = 0; i < ncpus; i++) {
+		p[i].cpu = i;
+		p[i].hist = calloc(PROBE_BUCKETS, sizeof(uint32_t));
+		if (!p[i].hist ||
+		    pthread_create(&p[i].thread, NULL, probe_run, &p[i])) {
+			fprintf(stderr, "cannot start latency probe\n");
+			exit(1);
+		}
+	}
+	return p;
+}
+
+static void probes_report(struct probe *p, int ncpus, const char *what)
+{
+	static const unsigned int permille[] = { 500, 990, 999 };
+	uint64_t total = 0, seen, want;
+	unsigned int i, b, worst = 0;
+	int cpu, worst_cpu = 0;
+
+	probes_stop = 1;
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		pthread_join(p[cpu].thread, NULL);
+		total += p[cpu].count;
+		for (b = PROBE_BUCKETS - 1; b > 0 && !p[cpu].hist[b]; b--)
+			;
+		if (b >= worst) {
+			worst = b;
+			worst_cpu = cpu;
+		}
+	}
+	printf("  wakeup_latency_us %s:", what);
+	for (i = 0; i < sizeof(permille) / sizeof(permille[0]); i++) {
+		want = (total * permille[i] + 999) / 1000;
+		seen = 0;
+		for (b = 0; b < PROBE_BUCKETS - 1; b++) {
+			for (cpu = 0; cpu < ncpus; cpu++)
+				seen += p[cpu].hist[b];
+			if (seen >= want)
+				break;
+		}
+		printf(" p%u.%u %u", permille[i] / 10, permille[i] % 10, b);
+	}
+	printf(" max %s%u (cpu %d)\n",
+	       worst == PROBE_BUCKETS - 1 ? ">=" : "", worst, worst_cpu);
+	for (cpu = 0; cpu < ncpus; cpu++)
+		free(p[cpu].hist);
+	free(p);
+}
+
+static void *loopback_run(void *arg)
+{
+	struct loopback *l = arg;
+
+	l->have = ir_read_frame(l->fd, l->buf, 0, l->want, 100);
+	return NULL;
+}
+
+static int write_file(const char *path, const char *s)
+{
+	FILE *fp = fopen(path, "w");
+
+	if (!fp)
+		return -1;
+	fputs(s, fp);
+	return fclose(fp);
+}
+
+static void print_file(const char *path)
+{
+	char line[256];
+	FILE *fp = fopen(path, "r");
+
+	if (!fp) {
+		perror(path);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp))
+		printf("  %s", line);
+	fclose(fp);
+}
+
+static pid_t stress_start(char *args)
+{
+	char *argv[64];
+	int argc = 0;
+	pid_t pid;
+
+	argv[argc++] = "stress-ng";
+	for (args = strtok(args, " "); args && argc < 62;
+	     args = strtok(NULL, " "))
+		argv[argc++] = args;
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	return pid;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-n repeats] [-g gap_ms] [-c cpu] [-l]"
+		" [-s stress-ng args]... frames...\n"
+		"  -d  lirc device (default " DEFAULT_DEVICE ")\n"
+		"  -n  times to send each frame per pass (default 10)\n"
+		"  -g  pause between frames in ms (default 50)\n"
+		"  -c  CPU to transmit from\n"
+		"  -l  read the frames back through gpio_in_pin and compare\n"
+		"  -s  add a pass with stress-ng running with these arguments\n"
+		"frames are mode2 text or lirc_tegra_record captures\n",
+		prog);
+	exit(2);
+}
+
+static void send_suite(int fd, const char *device, struct ir_suite *suite,
+		       unsigned int repeats, unsigned int gap_ms,
+		       struct loopback *lb, struct ir_errs *errs)
+{
+	struct ir_frame *f;
+	unsigned int r, i;
+
+	for (r = 0; r < repeats; r++) {
+		for (i = 0; i < suite->count; i++) {
+			f = &suite->frames[i];
+			if (lb) {
+				ir_drain(fd);
+				lb->want = 2 * f->count;
+				if (pthread_create(&lb->thread, NULL,
+						   loopback_run, lb)) {
+					perror("pthread_create");
+					exit(1);
+				}
+			}
+			if (ir_write_all(fd, f->samples, f->count))
+				perror(device);
+			if (lb) {
+				pthread_join(lb->thread, NULL);
+				if (lb->have >= 0)
+					ir_errs_compare(&errs[f->file],
+							f->samples, f->count,
+							lb->buf, lb->have);
+			}
+			sleep_ns(gap_ms * 1000000ULL);
+		}
+	}
+}
+
+static void report_loopback(struct ir_suite *suite, struct ir_errs *errs)
+{
+	struct ir_errs total;
+	unsigned int f;
+
+	memset(&total, 0, sizeof(total));
+	ir_errs_report_files(stdout, "  loopback ", suite, errs, &total);
+	ir_errs_report(stdout, "  loopback all", &total);
+	ir_errs_free(&total);
+	for (f = 0; f < suite->files; f++)
+		ir_errs_free(&errs[f]);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = DEFAULT_DEVICE;
+	char *stress[MAX_PASSES];
+	char txlog_old[8] = "0";
+	unsigned int repeats = 10, gap_ms = 50, pass, npasses = 1;
+	int opt, fd, cpu = -1, loopback = 0, ncpus, status;
+	struct ir_suite suite;
+	struct ir_errs *errs;
+	struct loopback lb;
+	struct probe *probes;
+	cpu_set_t set;
+	pid_t pid;
+	FILE *fp;
+
+	stress[0] = NULL;
+	while ((opt = getopt(argc, argv, "d:n:g:c:ls:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			repeats = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gap_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'l':
+			loopback = 1;
+			break;
+		case 's':
+			if (npasses == MAX_PASSES)
+				usage(argv[0]);
+			stress[npasses++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		usage(argv[0]);
+
+	memset(&suite, 0, sizeof(suite));
+	for (; optind < argc; optind++) {
+		if (ir_suite_load(&suite, argv[optind])) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	if (!suite.count) {
+		fprintf(stderr, "no frames\n");
+		return 1;
+	}
+
+	fd = open(device, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			perror("sched_setaffinity");
+			return 1;
+		}
+	}
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	errs = calloc(suite.files, sizeof(*errs));
+	lb.buf = malloc(2 * suite.max_count * sizeof(int));
+	if (!errs || !lb.buf) {
+		perror("malloc");
+		return 1;
+	}
+	lb.fd = fd;
+
+	/* tx_stats only accumulates while the tx log is on */
+	fp = fopen(TXLOG_PARAM, "r");
+	if (fp) {
+		if (!fgets(txlog_old, sizeof(txlog_old), fp))
+			strcpy(txlog_old, "0");
+		fclose(fp);
+	}
+	if (write_file(TXLOG_PARAM, "1"))
+		perror(TXLOG_PARAM);
+
+	for (pass = 0; pass < npasses; pass++) {
+		printf("== %s%s\n", stress[pass] ? "stress-ng " : "idle",
+		       stress[pass] ? stress[pass] : "");
+		pid = stress[pass] ? stress_start(stress[pass]) : 0;
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+
+		/* the same load with nothing being sent, for comparison */
+		probes = probes_start(ncpus);
+		sleep_ns(WARMUP_S * 1000000000ULL);
+		probes_report(probes, ncpus, "baseline");
+		if (pid && waitpid(pid, &status, WNOHANG) == pid) {
+			fprintf(stderr, "stress-ng exited early\n");
+			break;
+		}
+
+		if (write_file(TX_STATS, "0"))
+			perror(TX_STATS);
+		probes = probes_start(ncpus);
+		send_suite(fd, device, &suite, repeats, gap_ms,
+			   loopback ? &lb : NULL, errs);
+		probes_report(probes, ncpus, "during tx");
+
+		if (pid) {
+			kill(pid, SIGTERM);
+			waitpid(pid, &status, 0);
+		}
+		print_file(TX_STATS);
+		if (loopback)
+			report_loopback(&suite, errs);
+		fflush(stdout);
+	}
+
+	write_file(TXLOG_PARAM, txlog_old);
+	close(fd);
+	ir_suite_free(&suite);
+	free(errs);
+	free(lb.buf);
+	return 0;
+}